@@ -0,0 +1,171 @@
+/*
+   g++ benchmark.cpp -std=c++17 -O2 -Wextra -Wall -pedantic-errors -pthread -o benchmark
+
+   ./benchmark [--threads 1,2,4,...,128] [--lines N] [--bytes N] > /dev/null   (or > file, the report goes to stderr)
+*/
+
+#include "parallel_cout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+/**
+   Contention of console output: 'threads' threads write 'lines' lines between them, every line is about 'bytes' long
+   ("[thread] counter payload...\n", the same text and the same insertions for every variant):
+      std::cout         - plain insertions into std::cout, lines of different threads may interleave,
+      sync_cout         - a std::stringstream per statement written to std::cout under a global mutex,
+      parallel::cout    - a thread-local buffer per statement, pushed into the lock-free ring of the flusher,
+      parallel::printf  - the arguments copied into a queue of the thread, formatted by the flusher.
+   Reported:
+      lines/s           - lines / wall time, which includes writing out everything (std::cout.flush(), parallel::flush()),
+      p50/p99/p999      - latency of a single statement on the writing thread,
+      wait              - time threads spent waiting for each other per line: for a contended lock of sync_cout
+                          (sync_cout::lock_wait()) and for space in the ring or queue of the flusher (parallel::stats()),
+                          the lock of std::cout is internal to the library and not measured.
+   Redirect stdout: the terminal would rather measure itself.
+*/
+
+struct options
+{
+   vector<size_t>   threads;
+   size_t           lines{200'000};
+   size_t           bytes{80};
+};
+
+options parse(int argc, char* argv[])
+{
+   options o;
+   for(int i{1}; i<argc; ++i) {
+      const string arg{argv[i]};
+      if(i+1>=argc)
+         throw invalid_argument{"missing value of " + arg};
+      const string value{argv[++i]};
+      if(arg=="--lines")
+         o.lines = max<size_t>(1, stoul(value));
+      else if(arg=="--bytes")
+         o.bytes = max<size_t>(24, stoul(value));
+      else if(arg=="--threads") {
+         istringstream list{value};
+         for(string t; getline(list, t, ',');)
+            o.threads.push_back(max<size_t>(1, stoul(t)));
+      }
+      else
+         throw invalid_argument{"unknown option " + arg};
+   }
+   if(o.threads.empty())
+      for(size_t t{1}; t<=128; t *= 2)
+         o.threads.push_back(t);
+   return o;
+}
+
+struct result
+{
+   double            lines_per_s;
+   vector<int64_t>   latency;   // ns of every statement, sorted
+   nanoseconds       wait;
+};
+
+/**
+   Runs 'write(thread, counter)' 'lines' times spread over 'threads' threads and 'drain',
+   'waited' returns the total wait of all threads so far
+*/
+template <typename Write, typename Drain, typename Waited>
+result run(size_t threads, size_t lines, Write write, Drain drain, Waited waited)
+{
+   vector<vector<int64_t>> latency(threads);
+   const auto waited_before = waited();
+   const auto start = steady_clock::now();
+   vector<thread> v;
+   for(size_t t{0}; t<threads; ++t)
+      v.emplace_back([&, t] {
+         const auto n = lines/threads + (t < lines%threads? 1 : 0);
+         auto& l = latency[t];
+         l.reserve(n);
+         for(size_t i{0}; i<n; ++i) {
+            const auto s = steady_clock::now();
+            write(t, i);
+            l.push_back(duration_cast<nanoseconds>(steady_clock::now()-s).count());
+         }
+      });
+   for(auto& t : v)
+      t.join();
+   drain();
+   const auto wall = duration<double>(steady_clock::now()-start).count();
+
+   result r{static_cast<double>(lines)/wall, {}, waited()-waited_before};
+   r.latency.reserve(lines);
+   for(auto& l : latency)
+      r.latency.insert(r.latency.end(), l.begin(), l.end());
+   sort(r.latency.begin(), r.latency.end());
+   return r;
+}
+
+int64_t percentile(const vector<int64_t>& sorted, double p)
+{
+   return sorted.empty()? 0 : sorted[min(sorted.size()-1, static_cast<size_t>(p * sorted.size()))];
+}
+
+int main(int argc, char* argv[])
+{
+   try {
+      const auto o = parse(argc, argv);
+      const string payload(o.bytes - 12, 'x');   // <-- "[tt] ccccc " + payload + "\n"
+      const string_view p{payload};
+      parallel::flush();   // <-- starts the flusher (and calibrates its clock) outside of the measurement
+
+      struct variant {
+         string                           name;
+         function<void(size_t, size_t)>   write;
+         function<void()>                 drain;
+         function<nanoseconds()>          waited;   // empty if it cannot be measured
+      };
+      const vector<variant> variants{
+         {"std::cout", [&](size_t t, size_t i) {
+               cout << "[" << t << "] " << i << " " << p << "\n";   // <-- no manipulators, they would race on the shared stream
+            }, [] { cout.flush(); }, {}},
+         {"sync_cout", [&](size_t t, size_t i) {
+               parallel::sync_cout{} << "[" << t << "] " << i << " " << p << "\n";
+            }, [] { cout.flush(); }, [] { return parallel::sync_cout::lock_wait(); }},
+         {"parallel::cout", [&](size_t t, size_t i) {
+               parallel::cout{} << "[" << t << "] " << i << " " << p << "\n";
+            }, [] { parallel::flush(); }, [] { return parallel::stats().wait_time; }},
+         {"parallel::printf", [&](size_t t, size_t i) {
+               parallel::printf("[%] % %\n", t, i, p);
+            }, [] { parallel::flush(); }, [] { return parallel::stats().wait_time; }},
+      };
+
+      cerr << "*** " << o.lines << " lines of " << o.bytes << " bytes, " << thread::hardware_concurrency() << " hardware threads\n"
+           << fixed << setprecision(1)
+           << left << setw(18) << "variant" << right << setw(8) << "threads" << setw(13) << "lines/s"
+           << setw(10) << "p50 ns" << setw(10) << "p99 ns" << setw(11) << "p999 ns" << setw(14) << "wait ns/line" << "\n";
+      for(const auto& v : variants)
+         for(auto t : o.threads) {
+            const auto r = run(t, o.lines, v.write, v.drain, v.waited? v.waited : [] { return nanoseconds{0}; });
+            cerr << left << setw(18) << v.name << right << setw(8) << t << setw(13) << setprecision(0) << r.lines_per_s
+                 << setw(10) << percentile(r.latency, .5) << setw(10) << percentile(r.latency, .99) << setw(11) << percentile(r.latency, .999)
+                 << setw(14) << setprecision(1);
+            if(v.waited)
+               cerr << static_cast<double>(r.wait.count()) / o.lines << "\n";
+            else
+               cerr << "-" << "\n";
+         }
+   }
+   catch(const exception& e) {
+      cerr << "*** error: " << e.what() << "\n";
+      return EXIT_FAILURE;
+   }
+}
@@ -1,34 +1,65 @@
-#include <sstream>
-#include <iostream>
-#include <mutex>
+/*
+   g++ main.cpp -std=c++17 -Wextra -Wall -pedantic-errors -pthread -o exe
+*/
 
-namespace parallel
-{
-   class cout : public std::stringstream {
-      inline static std::mutex m_;
-   public:
-      ~cout() {
-         std::lock_guard<std::mutex> lock{m_};
-         std::cout << rdbuf();
-      }
-   };
-}  // end namespace parallel
+#include "parallel_cout.h"
 
 ////// Example of Usage //////
 
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 using namespace std;
 
+/**
+   Heap allocations made by the calling thread, to check that a statement of parallel::cout allocates nothing.
+   The replacements are not inlined: GCC would otherwise see malloc'ed memory released by operator delete
+   (or new'ed memory by free) and warn with -Wmismatched-new-delete.
+*/
+thread_local size_t allocations{0};
+
+[[gnu::noinline]] void* operator new(size_t n)
+{
+   ++allocations;
+   if(void* p = malloc(n ? n : 1))
+      return p;
+   throw bad_alloc{};
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept
+{
+   free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept
+{
+   free(p);
+}
+
 void print_cout(string s, size_t n) {
    cout << "[" << n << "]: " << s << endl;
 }
 
+void print_scout(string s, size_t n) {
+   parallel::sync_cout{} << "[" << n << "]: " << s << endl;
+}
+
 void print_pcout(string s, size_t n) {
    parallel::cout{} << "[" << n << "]: " << s << endl;
 }
 
+void print_deferred(string s, size_t n) {
+   parallel::printf("[%]: % %\n", n, s, 3.14159);   // <--- the text is formatted by the flusher thread
+}
+
 template <typename F>
 void run10threads(F f, string greeting)
 {
@@ -38,9 +69,133 @@ void run10threads(F f, string greeting)
    for(auto& t:v) t.join();
 }
 
+/**
+   Once the thread-local buffer of a thread has grown to its longest line, a statement costs no allocation.
+   The check does not depend on assert(), so it holds for -DNDEBUG builds too.
+*/
+atomic<size_t> allocating_threads{0};
+
+void print_no_alloc(string s, size_t n) {
+   parallel::cout{} << "[" << n << "]: " << s << " " << 3.14159 << endl;   // <--- warm up
+   const auto before = allocations;
+   for(size_t i{0}; i<1000; ++i)
+      parallel::cout{} << "[" << n << "]: " << s << " " << 3.14159 << " #" << i << endl;
+   const auto steady = allocations - before;
+   if(steady!=0)
+      ++allocating_threads;
+   parallel::cout{} << "[" << n << "]: " << steady << " allocations in 1000 lines" << endl;
+}
+
+/**
+   Levels: trace and debug statements are compiled out by -DNDEBUG (or -DPARALLEL_COUT_LEVEL=info),
+   the others are thinned out at run time
+*/
+void print_levels()
+{
+   using parallel::level;
+   size_t evaluated{0};
+   const auto costly = [&] { ++evaluated; return "costly"; };
+
+   PARALLEL_COUT(trace) << "trace: " << costly() << endl;   // <--- costly() is not called at all with -DNDEBUG
+   parallel::sample(level::debug, 4);
+   for(size_t i{0}; i<8; ++i)
+      PARALLEL_COUT(debug) << "debug #" << i << ": " << costly() << endl;   // <--- 1 of 4 is kept, costly() is called for those only
+   parallel::sample(level::debug, 1);
+
+   parallel::rate_limit(level::warning, 3);
+   for(size_t i{0}; i<100; ++i)
+      parallel::printf<level::warning>("warning #%\n", i);   // <--- 3 per second, a burst of 3
+   parallel::rate_limit(level::warning, 0);
+
+   parallel::cout{} << "costly() called " << evaluated << " times, " << parallel::stats().filtered << " statements filtered out" << endl;
+}
+
+/**
+   Lines of parallel::cout and parallel::printf come out in the order of their stamps: "<seconds> t<thread>#<seq>"
+*/
+void print_stamped(string s, size_t n) {
+   parallel::cout{} << "[" << n << "]: " << s << endl;
+   parallel::printf("[%]: % again\n", n, s);
+}
+
+/**
+   The same threads logging into memory-mapped files of 64 KiB, the last 3 of them are kept
+*/
+void log_to_files()
+{
+   const auto path = filesystem::temp_directory_path() / "parallel_cout.log";
+   auto file = make_shared<parallel::mmap_file_sink>(path.string(), 64*1024, 3);
+   parallel::set_sink(file);
+   run10threads([](string s, size_t n) {
+      for(size_t i{0}; i<1000; ++i)
+         parallel::cout{} << "[" << n << "]: " << s << " #" << i << endl;
+   }, "Hello mmap_file_sink");
+   parallel::set_sink(nullptr);   // <--- back to stdout, the files are complete by now
+   file.reset();
+
+   for(const auto& p : {path.string(), path.string()+".1", path.string()+".2", path.string()+".3"}) {
+      ifstream in{p};
+      size_t lines{0};
+      for(string l; getline(in, l);)
+         ++lines;
+      parallel::cout{} << p << ": " << (in.eof()? to_string(lines) + " lines" : string{"none"}) << endl;
+   }
+}
+
+/**
+   A sink as slow as a congested disk, the ring fills up and the overflow policy decides what the logging threads do
+*/
+class slow_sink : public parallel::sink {
+public:
+   void write(string_view) override {
+      this_thread::sleep_for(chrono::milliseconds{1});
+   }
+};
+
+void log_to_slow_sink(parallel::overflow policy, const string& name, shared_ptr<parallel::sink> spill = nullptr)
+{
+   parallel::set_sink(make_shared<slow_sink>());   // <--- flushes the lines so far
+   const auto before = parallel::stats();
+   parallel::set_overflow(policy, spill);
+   run10threads([](string s, size_t n) {
+      for(size_t i{0}; i<10'000; ++i)
+         parallel::cout{} << "[" << n << "]: " << s << " #" << i << endl;   // <--- never waits for the slow sink
+   }, "Hello " + name);
+   parallel::set_sink(nullptr);
+   parallel::set_overflow(parallel::overflow::block);
+
+   const auto s = parallel::stats();
+   parallel::cout{} << name << ": " << s.enqueued-before.enqueued << " enqueued, " << s.dropped-before.dropped << " dropped, "
+                    << s.spilled-before.spilled << " spilled, " << s.flushed-before.flushed << " flushed, "
+                    << "the ring was filled up to " << s.ring_high_water << " bytes" << endl;
+}
+
 int main()
 {
    run10threads(print_cout, "Hello std::cout");
+   run10threads(print_scout,"Hello parallel::sync_cout");
+   cout.flush();
    run10threads(print_pcout,"Hello parallel::cout");
+   parallel::flush();
+   run10threads(print_no_alloc,"Hello allocation-free parallel::cout");
+   parallel::flush();
+   if(allocating_threads) {
+      cerr << "*** " << allocating_threads << " thread(s) allocated while printing" << endl;
+      return EXIT_FAILURE;
+   }
+   run10threads(print_deferred,"Hello parallel::printf");
+   parallel::flush();
+   print_levels();
+   parallel::flush();
+   parallel::show_stamps();
+   run10threads(print_stamped,"Hello stamped parallel::cout");
+   parallel::flush();
+   parallel::show_stamps(false);
+   log_to_files();
+   parallel::flush();
+   log_to_slow_sink(parallel::overflow::drop_newest, "drop_newest");
+   log_to_slow_sink(parallel::overflow::drop_oldest, "drop_oldest");
+   const auto spill = filesystem::temp_directory_path() / "parallel_cout.spill";
+   log_to_slow_sink(parallel::overflow::spill, "spill", make_shared<parallel::mmap_file_sink>(spill.string(), 64*1024*1024, 0));
+   parallel::flush();
 }
-
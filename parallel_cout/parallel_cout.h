@@ -0,0 +1,1730 @@
+#if !defined(_PARALLEL_COUT_H__)
+#define _PARALLEL_COUT_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+#endif
+
+#if !defined(PARALLEL_COUT_LEVEL)   // <-- the lowest level which is compiled in, e.g. -DPARALLEL_COUT_LEVEL=warning
+#if defined(NDEBUG)
+#define PARALLEL_COUT_LEVEL info
+#else
+#define PARALLEL_COUT_LEVEL trace
+#endif
+#endif
+
+#if !defined(PARALLEL_COUT_COARSE_CLOCK) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define _PARALLEL_COUT_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+/**
+   Synchronizing concurrent std::cout use
+   --------------------------------------
+   parallel::sync_cout  - a statement is formatted into its own std::stringstream and written to std::cout
+                          under a global mutex by the destructor, i.e. at the end of the full expression
+   parallel::cout       - the same statement, but the completed line is pushed into a lock-free ring
+                          and a background flusher thread writes the ring to stdout in large write(2) batches,
+                          so a logging thread never waits for the console (unless the ring is full);
+                          the statement is formatted into a thread-local buffer, in the steady state it costs no heap allocation
+   parallel::printf     - deferred formatting: the raw bytes of the arguments and the id of a format descriptor
+                          are copied into a queue of the calling thread, the flusher does all the text formatting
+   parallel::set_sink   - the flusher writes to stdout (console_sink) by default,
+                          mmap_file_sink is a memory-mapped log file rotated by size
+   parallel::cout<level> - a statement of a severity level, levels below PARALLEL_COUT_LEVEL compile to nothing,
+                          PARALLEL_COUT(debug) << ... does not even evaluate the arguments then;
+                          parallel::sample / parallel::rate_limit thin out the statements of a level at run time
+   parallel::show_stamps - every line is stamped with cheap clock ticks (TSC or CLOCK_MONOTONIC_COARSE) and a per-thread
+                          sequence number, the flusher writes lines in the order of their stamps within a reorder window
+   parallel::set_overflow - what a statement does when the ring is full: block (the default), drop the newest
+                          or the oldest line, or spill the line to another sink; parallel::stats() counts the lines
+
+   Usage Example:
+      parallel::cout{} << "[" << n << "]: " << s << endl;
+      parallel::flush();   // <-- waits until every line pushed so far is written
+
+   Note:
+      - lines of one thread keep their order (those of parallel::cout and parallel::printf alike),
+        lines of different threads are never interleaved and come out in the order of their stamps
+        unless a line is published later than the reorder window (1 ms by default) after it was stamped;
+      - parallel::cout bypasses the buffer of std::cout, mixing both may reorder their output
+        (call std::cout.flush() before and parallel::flush() after a parallel section);
+      - the flusher is started on first use and drains the ring at exit.
+*/
+
+namespace parallel
+{
+   class sync_cout : public std::stringstream {
+      inline static std::mutex m_;
+      inline static std::atomic<std::int64_t> waited_{0};   // ns, only a contended lock is timed
+   public:
+      ~sync_cout() {
+         std::unique_lock<std::mutex> lock{m_, std::try_to_lock};
+         if(!lock.owns_lock()) {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            waited_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count(), std::memory_order_relaxed);
+         }
+         std::cout << rdbuf();
+      }
+
+      /**
+         \return the total time threads have waited for each other's lines so far
+      */
+      static std::chrono::nanoseconds lock_wait() noexcept {
+         return std::chrono::nanoseconds{waited_.load(std::memory_order_relaxed)};
+      }
+   };
+
+   /**
+      Counters of parallel::cout and parallel::printf, see parallel::stats()
+   */
+   struct statistics {
+      std::size_t                waits;              // statements which found the ring (or their queue) full and waited
+      std::chrono::nanoseconds   wait_time;          // spent by them until there was space
+      std::size_t                filtered;           // statements dropped by parallel::sample and parallel::rate_limit
+      std::size_t                enqueued;           // lines pushed into the ring and records into the queues
+      std::size_t                dropped;            // lines lost by overflow::drop_newest and overflow::drop_oldest
+      std::size_t                spilled;            // lines written to the spill sink of overflow::spill
+      std::size_t                flushed;            // lines written to the sink
+      std::size_t                ring_high_water;    // the most bytes of the ring in use, as the flusher found it
+      std::size_t                queue_high_water;   // the most bytes in use of a queue of parallel::printf
+   };
+
+   /**
+      What a statement does when the ring of the flusher is full (the disk or the console cannot keep up), see parallel::set_overflow()
+   */
+   enum class overflow {
+      block,         // waits for the flusher, nothing is lost but a slow sink stalls the logging threads
+      drop_newest,   // the statement is dropped
+      drop_oldest,   // the oldest lines in the ring are dropped to make room for it
+      spill          // the calling thread writes the line to a spill sink, out of order with the others
+   };
+
+   enum class level { trace, debug, info, warning, error };
+
+   inline constexpr level compiled_level = level::PARALLEL_COUT_LEVEL;
+
+   /**
+      Statements of a disabled level compile to nothing
+   */
+   template <level L>
+   inline constexpr bool enabled = L>=compiled_level;
+
+   namespace detail
+   {
+      /**
+         Writes the whole buffer to a file descriptor, a partial write or EINTR is retried
+      */
+      inline void write_all(int fd, const char* p, std::size_t n) noexcept {
+         while(n>0) {
+#if defined(_WIN32)
+            const auto r = ::_write(fd, p, static_cast<unsigned>(std::min<std::size_t>(n, 1u<<30)));
+#else
+            const auto r = ::write(fd, p, n);
+            if(r<0 && errno==EINTR)
+               continue;
+#endif
+            if(r<=0)
+               return;   // <-- nowhere to report it, the console is gone
+            p += r;
+            n -= static_cast<std::size_t>(r);
+         }
+      }
+
+   }  // namespace detail
+
+   /**
+      Destination of the text, written by the flusher thread with batches of complete lines
+      (a spill sink of overflow::spill by the logging threads one line at a time, under a lock)
+   */
+   class sink {
+   public:
+      virtual ~sink() = default;
+      virtual void write(std::string_view text) = 0;
+   };
+
+   /**
+      A file descriptor, stdout by default
+   */
+   class console_sink : public sink {
+      const int fd_;
+   public:
+      explicit console_sink(int fd = 1) noexcept : fd_(fd) {}
+      void write(std::string_view text) override {
+         detail::write_all(fd_, text.data(), text.size());
+      }
+   };
+
+#if !defined(_WIN32)
+   /**
+      A log file mapped into memory and rotated by size: 'path' is written until it holds 'file_bytes',
+      then it is renamed to 'path.1' (the older ones shift to 'path.2'...'path.<keep>', the oldest is removed)
+      and a new 'path' is started. An existing 'path' is rotated on construction.
+      A write reserves its range of the mapping by a single atomic compare-exchange and copies the text there,
+      there is no system call except at rotation. write() may be called by several threads concurrently.
+      A file ends with a complete line unless a single line is longer than 'file_bytes'.
+   */
+   class mmap_file_sink : public sink {
+      struct region {
+         int                        fd{-1};
+         char*                      base{nullptr};
+         std::size_t                size{0};
+         std::atomic<std::size_t>   reserved{0};
+         std::atomic<std::size_t>   used{0};   // bytes copied, the file is cut to it when the region is released
+
+         ~region() {
+            if(base)
+               ::munmap(base, size);
+            if(fd>=0) {
+               [[maybe_unused]] const auto r = ::ftruncate(fd, static_cast<off_t>(used.load()));
+               ::close(fd);
+            }
+         }
+      };
+
+      const std::string          path_;
+      const std::size_t          file_bytes_;
+      const unsigned             keep_;
+      std::shared_ptr<region>    region_;   // accessed by std::atomic_load/atomic_store
+      std::mutex                 rotate_m_;
+      std::atomic<std::size_t>   rotations_{0};
+
+      static void throw_errno(const std::string& what) {
+         throw std::system_error{errno, std::generic_category(), "parallel::mmap_file_sink: " + what};
+      }
+
+      void shift_files() const {
+         std::remove((path_ + "." + std::to_string(keep_)).c_str());
+         for(auto i = keep_; i>1; --i)
+            std::rename((path_ + "." + std::to_string(i-1)).c_str(), (path_ + "." + std::to_string(i)).c_str());
+         if(keep_>0)
+            std::rename(path_.c_str(), (path_ + ".1").c_str());
+         else
+            std::remove(path_.c_str());
+      }
+
+      std::shared_ptr<region> open_region() const {
+         auto r = std::make_shared<region>();
+         r->fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+         if(r->fd<0)
+            throw_errno("cannot open " + path_);
+         if(::ftruncate(r->fd, static_cast<off_t>(file_bytes_))!=0)
+            throw_errno("cannot resize " + path_);
+         void* p = ::mmap(nullptr, file_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+         if(p==MAP_FAILED)
+            throw_errno("cannot map " + path_);
+         r->base = static_cast<char*>(p);
+         r->size = file_bytes_;
+         return r;
+      }
+
+      /**
+         Starts a new file unless another thread has already replaced 'full'
+      */
+      void rotate(const std::shared_ptr<region>& full) {
+         std::lock_guard<std::mutex> l{rotate_m_};
+         if(std::atomic_load(&region_)!=full)
+            return;
+         shift_files();
+         std::atomic_store(&region_, open_region());
+         ++rotations_;
+      }
+
+   public:
+      explicit mmap_file_sink(std::string path, std::size_t file_bytes = 64*1024*1024, unsigned keep = 4)
+         : path_(std::move(path)), file_bytes_(std::max<std::size_t>(file_bytes, 4096)), keep_(keep) {
+         if(::access(path_.c_str(), F_OK)==0)
+            shift_files();
+         region_ = open_region();
+      }
+
+      void write(std::string_view text) override {
+         while(!text.empty()) {
+            const auto r = std::atomic_load(&region_);
+            auto start = r->reserved.load(std::memory_order_relaxed);
+            std::size_t n{0};
+            do {
+               const auto left = r->size - start;
+               n = text.size();
+               if(n > left) {
+                  // <-- as many complete lines as fit, a line longer than a whole file is cut
+                  const auto eol = text.substr(0, left).rfind('\n');
+                  n = eol!=std::string_view::npos? eol+1 : (start==0? left : 0);
+               }
+            } while(n>0 && !r->reserved.compare_exchange_weak(start, start+n, std::memory_order_relaxed));
+            if(n==0) {
+               rotate(r);   // <-- the unused tail of the full file is cut off
+               continue;
+            }
+            std::memcpy(r->base + start, text.data(), n);
+            r->used.fetch_add(n, std::memory_order_relaxed);
+            text.remove_prefix(n);
+         }
+      }
+
+      /**
+         \return how many times a new file has been started
+      */
+      std::size_t rotations() const noexcept {
+         return rotations_.load(std::memory_order_relaxed);
+      }
+   };
+#endif
+
+   namespace detail
+   {
+      /**
+         Cheap timestamps of lines: the time stamp counter on x86, CLOCK_MONOTONIC_COARSE on other Linux hosts
+         and std::chrono::steady_clock elsewhere. Reading it is a few nanoseconds, unlike std::chrono::system_clock::now().
+         The rate of the counter is measured once against steady_clock when the flusher starts.
+         Define PARALLEL_COUT_COARSE_CLOCK on x86 hosts without an invariant TSC (the counters of cores may drift apart there).
+      */
+      class tick_clock {
+         std::uint64_t   start_;
+         double          ns_per_tick_{1.0};
+
+         tick_clock() : start_(now()) {
+#if defined(_PARALLEL_COUT_TSC)
+            const auto t0 = std::chrono::steady_clock::now();
+            const auto c0 = now();
+            std::this_thread::sleep_for(std::chrono::milliseconds{2});
+            const auto t1 = std::chrono::steady_clock::now();
+            const auto c1 = now();
+            if(c1>c0)
+               ns_per_tick_ = std::chrono::duration<double, std::nano>(t1-t0).count() / static_cast<double>(c1-c0);
+            start_ = c0;
+#endif
+         }
+
+      public:
+         static std::uint64_t now() noexcept {
+#if defined(_PARALLEL_COUT_TSC)
+            return __rdtsc();
+#elif defined(__linux__)
+            timespec ts;
+            ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec)*1000000000u + static_cast<std::uint64_t>(ts.tv_nsec);
+#else
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+         }
+
+         static const tick_clock& calibrated() {
+            static const tick_clock c;
+            return c;
+         }
+
+         std::uint64_t ticks(std::chrono::nanoseconds d) const noexcept {
+            return d.count()>0? static_cast<std::uint64_t>(static_cast<double>(d.count()) / ns_per_tick_) : 0;
+         }
+         std::chrono::nanoseconds duration(std::uint64_t ticks) const noexcept {
+            return std::chrono::nanoseconds{static_cast<std::int64_t>(static_cast<double>(ticks) * ns_per_tick_)};
+         }
+         /**
+            \return the time of 'ticks' since the clock was calibrated
+         */
+         std::chrono::nanoseconds since_start(std::uint64_t ticks) const noexcept {
+            return duration(ticks>start_? ticks-start_ : 0);
+         }
+      };
+
+      /**
+         When and by whom a line was made: the clock ticks, the thread and its running count of lines.
+         Lines are written in the order of (ticks, thread, seq), the lines of a thread keep their order
+         because its ticks never decrease and the flusher does not skip a seq of a thread while its line may still come
+         (only a dropped line leaves a gap).
+      */
+      struct stamp {
+         std::uint64_t   ticks;
+         std::uint32_t   thread;
+         std::uint32_t   seq;   // wraps around, only consecutive lines of a thread are compared
+
+      private:
+         struct thread_t {
+            std::uint32_t   id;
+            std::uint32_t   seq{0};
+         };
+         static thread_t& local() noexcept {
+            static std::atomic<std::uint32_t> threads{0};
+            thread_local thread_t t{threads++};
+            return t;
+         }
+
+      public:
+         /**
+            \return the stamp of the next line of the calling thread
+         */
+         static stamp next() noexcept {
+            auto& t = local();
+            return {tick_clock::now(), t.id, t.seq++};
+         }
+         /**
+            \return a stamp which does not count as a line, e.g. of a line which is written bypassing the flusher
+         */
+         static stamp now() noexcept {
+            const auto& t = local();
+            return {tick_clock::now(), t.id, t.seq};
+         }
+
+         friend bool operator<(const stamp& a, const stamp& b) noexcept {
+            if(a.ticks!=b.ticks)
+               return a.ticks<b.ticks;
+            return a.thread!=b.thread? a.thread<b.thread : static_cast<std::int32_t>(a.seq-b.seq)<0;
+         }
+      };
+
+      /**
+         Bounded multi-producer/single-consumer ring of lines.
+         A line occupies one or more consecutive slots which a producer reserves by a single CAS of 'tail_'.
+         The stamp of a line leads its text in the first slot.
+         Every slot carries a sequence number (see D.Vyukov's bounded MPMC queue):
+            seq == pos           - the slot is free for the producer of position 'pos',
+            seq == pos+1         - the first slot of a line at 'pos' is published (the rest of its slots are written before),
+            seq == pos+capacity  - the consumer has released it for the next lap.
+         The consumer releases slots in order, so a reservation is free if its last slot is.
+         A producer may drop the oldest line in place of the consumer, under the lock the consumer pops with (overflow::drop_oldest).
+
+         \see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+      */
+      class line_ring {
+      public:
+         static constexpr std::size_t slot_bytes = 128;
+
+      private:
+         struct alignas(64) slot {
+            std::atomic<std::size_t>   seq;
+            std::uint32_t              size;   // bytes of the line, the first slot only
+            char                       data[slot_bytes - sizeof(std::atomic<std::size_t>) - sizeof(std::uint32_t)];
+         };
+         static_assert(sizeof(slot)==slot_bytes);
+
+      public:
+         static constexpr std::size_t payload = sizeof(slot::data);
+         static_assert(sizeof(stamp) < payload);
+
+      private:
+         std::unique_ptr<slot[]>                 slots_;
+         const std::size_t                       mask_;
+         alignas(64) std::atomic<std::size_t>    tail_{0};     // next position to reserve
+         std::atomic<std::size_t>                pushed_{0};   // lines, on the cache line which the producer has just won by the CAS
+         alignas(64) std::atomic<std::size_t>    head_{0};     // next position to read, by the consumer (or a producer under its lock)
+
+         static std::size_t round_up(std::size_t n) noexcept {
+            std::size_t c{2};
+            while(c<n)
+               c *= 2;
+            return c;
+         }
+
+         static std::size_t slots_for(std::size_t bytes) noexcept {
+            return std::max<std::size_t>(1, (bytes + payload - 1) / payload);
+         }
+
+         void release(std::size_t head, std::size_t k) noexcept {
+            for(std::size_t i{0}; i<k; ++i)
+               slots_[(head+i) & mask_].seq.store(head+i+capacity(), std::memory_order_release);
+            head_.store(head+k, std::memory_order_release);
+         }
+
+      public:
+         explicit line_ring(std::size_t slots)
+            : slots_(new slot[round_up(slots)]), mask_(round_up(slots)-1) {
+            for(std::size_t i{0}; i<=mask_; ++i)
+               slots_[i].seq.store(i, std::memory_order_relaxed);
+         }
+
+         std::size_t capacity() const noexcept {
+            return mask_+1;
+         }
+         /**
+            \return the longest line which fits in the ring
+         */
+         std::size_t max_line() const noexcept {
+            return capacity() * payload - sizeof(stamp);
+         }
+
+         /**
+            \return false if the ring is full (or the line is longer than max_line())
+         */
+         bool try_push(const stamp& st, std::string_view line) noexcept {
+            const auto k = slots_for(sizeof(stamp) + line.size());
+            if(k>capacity())
+               return false;
+            auto pos = tail_.load(std::memory_order_relaxed);
+            for(;;) {
+               const auto last = pos + k - 1;
+               const auto seq  = slots_[last & mask_].seq.load(std::memory_order_acquire);
+               const auto diff = static_cast<std::ptrdiff_t>(seq - last);
+               if(diff==0) {
+                  if(tail_.compare_exchange_weak(pos, pos+k, std::memory_order_relaxed))
+                     break;
+               }
+               else if(diff<0)
+                  return false;
+               else
+                  pos = tail_.load(std::memory_order_relaxed);
+            }
+            auto& first = slots_[pos & mask_];
+            std::memcpy(first.data, &st, sizeof(st));
+            for(std::size_t i{0}, off{0}; i<k; ++i) {
+               const auto skip = i==0? sizeof(stamp) : 0;
+               const auto n = std::min(payload - skip, line.size() - off);
+               if(n>0)
+                  std::memcpy(slots_[(pos+i) & mask_].data + skip, line.data()+off, n);
+               off += n;
+            }
+            first.size = static_cast<std::uint32_t>(line.size());
+            first.seq.store(pos+1, std::memory_order_release);
+            pushed_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+         }
+
+         /**
+            Appends the next line to 'out'
+            \return false if the ring is empty (or the next line is not published yet)
+         */
+         bool try_pop(stamp& st, std::string& out) {
+            const auto head = head_.load(std::memory_order_relaxed);
+            auto& first = slots_[head & mask_];
+            if(first.seq.load(std::memory_order_acquire)!=head+1)
+               return false;
+            const std::size_t size = first.size;
+            const auto k = slots_for(sizeof(stamp) + size);
+            std::memcpy(&st, first.data, sizeof(st));
+            for(std::size_t i{0}, off{0}; i<k; ++i) {
+               const auto skip = i==0? sizeof(stamp) : 0;
+               const auto n = std::min(payload - skip, size - off);
+               out.append(slots_[(head+i) & mask_].data + skip, n);
+               off += n;
+            }
+            release(head, k);
+            return true;
+         }
+         /**
+            Frees the next line unread, as the consumer does
+            \return false if the ring is empty (or the next line is not published yet)
+         */
+         bool try_drop() noexcept {
+            const auto head = head_.load(std::memory_order_relaxed);
+            const auto& first = slots_[head & mask_];
+            if(first.seq.load(std::memory_order_acquire)!=head+1)
+               return false;
+            release(head, slots_for(sizeof(stamp) + first.size));
+            return true;
+         }
+
+         /**
+            \return the position which follows every line reserved so far
+         */
+         std::size_t reserved() const noexcept {
+            return tail_.load(std::memory_order_acquire);
+         }
+         /**
+            \return the position which follows every line popped (or dropped) so far
+         */
+         std::size_t popped() const noexcept {
+            return head_.load(std::memory_order_acquire);
+         }
+         /**
+            \return the number of lines pushed so far
+         */
+         std::size_t lines() const noexcept {
+            return pushed_.load(std::memory_order_relaxed);
+         }
+      };
+
+      /**
+         std::streambuf which appends to a std::string, the capacity survives clear()
+      */
+      class line_buffer : public std::streambuf {
+         std::string line_;
+      protected:
+         int_type overflow(int_type c) override {
+            if(!traits_type::eq_int_type(c, traits_type::eof()))
+               line_.push_back(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+         }
+         std::streamsize xsputn(const char* s, std::streamsize n) override {
+            line_.append(s, static_cast<std::size_t>(n));
+            return n;
+         }
+      public:
+         line_buffer() {
+            line_.reserve(256);
+         }
+         std::string_view view() const noexcept {
+            return line_;
+         }
+         void clear() noexcept {
+            line_.clear();
+         }
+      };
+
+      /**
+         Single-producer/single-consumer queue of variable-size records in a byte ring, one per thread of parallel::printf.
+         A record is a header and a payload, both 8-byte aligned. A record which does not fit before the end of the ring
+         is preceded by a 'skip' header which pads the rest of the lap.
+      */
+      class record_queue {
+         struct header {
+            std::uint32_t   bytes;   // of the whole record including the header
+            std::uint32_t   skip;    // padding up to the end of the ring
+         };
+
+         std::unique_ptr<unsigned char[]>        data_;
+         const std::size_t                       mask_;
+         std::size_t                             write_{0};   // the producer only
+         std::size_t                             read_{0};    // the consumer only
+         std::size_t                             due_{0};     // the consumer only, see make_due()
+         alignas(64) std::atomic<std::size_t>    committed_{0};   // up to here records are complete
+         std::atomic<std::size_t>                records_{0};     // committed so far
+         alignas(64) std::atomic<std::size_t>    released_{0};    // up to here records are written out, the space is free
+         std::atomic<bool>                       orphaned_{false};   // the producer thread has exited
+
+      public:
+         static constexpr std::size_t align = 8;
+
+         explicit record_queue(std::size_t bytes)
+            : data_(new unsigned char[bytes]), mask_(bytes-1) {}
+
+         std::size_t capacity() const noexcept {
+            return mask_+1;
+         }
+         /**
+            \return the largest payload a record may have
+         */
+         std::size_t max_payload() const noexcept {
+            return capacity()/4 - sizeof(header);
+         }
+
+         /**
+            \return space for a payload of 'n' bytes (n <= max_payload()), nullptr if the queue is full
+         */
+         unsigned char* reserve(std::size_t n) noexcept {
+            const auto bytes = (sizeof(header) + n + align - 1) / align * align;
+            const auto off   = write_ & mask_;
+            const auto pad   = off + bytes > capacity()? capacity() - off : 0;
+            if(write_ + pad + bytes - released_.load(std::memory_order_acquire) > capacity())
+               return nullptr;
+            if(pad>0) {
+               ::new(data_.get() + off) header{static_cast<std::uint32_t>(pad), 1};
+               write_ += pad;
+            }
+            ::new(data_.get() + (write_ & mask_)) header{static_cast<std::uint32_t>(bytes), 0};
+            return data_.get() + (write_ & mask_) + sizeof(header);
+         }
+         /**
+            Publishes the record of the last reserve()
+         */
+         void commit() noexcept {
+            write_ += reinterpret_cast<const header*>(data_.get() + (write_ & mask_))->bytes;
+            committed_.store(write_, std::memory_order_release);
+            records_.store(records_.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);   // <-- the producer is the only writer
+         }
+
+         /**
+            Invokes f(payload) for the next record
+            \return false if there is none
+         */
+         template <typename F>
+         bool pop(F&& f) {
+            const auto committed = committed_.load(std::memory_order_acquire);
+            while(read_!=committed) {
+               const auto* h = reinterpret_cast<const header*>(data_.get() + (read_ & mask_));
+               const auto bytes = h->bytes;
+               if(!h->skip) {
+                  f(reinterpret_cast<const unsigned char*>(h) + sizeof(header));
+                  read_ += bytes;
+                  return true;
+               }
+               read_ += bytes;
+            }
+            return false;
+         }
+         /**
+            Records committed so far are due: they must be popped even if the consumer has no room for more,
+            e.g. they precede a line which it has popped from elsewhere
+         */
+         void make_due() noexcept {
+            due_ = committed();
+         }
+         bool due() const noexcept {
+            return read_<due_;
+         }
+
+         /**
+            Frees the space of the records popped so far, they must be written out before
+         */
+         void release() noexcept {
+            released_.store(read_, std::memory_order_release);
+         }
+
+         std::size_t committed() const noexcept {
+            return committed_.load(std::memory_order_acquire);
+         }
+         /**
+            \return the position which follows every record popped so far, the consumer only
+         */
+         std::size_t popped() const noexcept {
+            return read_;
+         }
+         std::size_t released() const noexcept {
+            return released_.load(std::memory_order_acquire);
+         }
+         bool empty() const noexcept {
+            return committed()==released();
+         }
+         std::size_t records() const noexcept {
+            return records_.load(std::memory_order_relaxed);
+         }
+
+         void orphan() noexcept {
+            orphaned_.store(true, std::memory_order_release);
+         }
+         bool orphaned() const noexcept {
+            return orphaned_.load(std::memory_order_acquire);
+         }
+      };
+
+      /**
+         How arguments of parallel::printf are stored in a record:
+            arithmetic types, enums and pointers   - their bytes,
+            strings (std::string, string_view, const char*, char arrays)   - the length and the characters,
+         i.e. a record never refers to memory of the producer except the format string, which must be a literal.
+      */
+      template <typename T, typename = void>
+      struct codec {
+         static_assert(sizeof(T)==0, "parallel::printf: an argument must be arithmetic, an enum, a pointer or a string");
+      };
+
+      template <typename T>
+      struct codec<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T> || (std::is_pointer_v<T> && !std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>)>> {
+         static std::size_t size(const T&) noexcept {
+            return sizeof(T);
+         }
+         static unsigned char* encode(unsigned char* p, const T& v) noexcept {
+            std::memcpy(p, &v, sizeof(T));
+            return p + sizeof(T);
+         }
+         static const unsigned char* decode(const unsigned char* p, std::ostream& os) {
+            T v;
+            std::memcpy(&v, p, sizeof(T));
+            if constexpr(std::is_enum_v<T>)
+               os << static_cast<std::underlying_type_t<T>>(v);
+            else if constexpr(std::is_pointer_v<T>)
+               os << static_cast<const void*>(v);
+            else
+               os << v;
+            return p + sizeof(T);
+         }
+      };
+
+      struct string_codec {
+         static std::size_t size(std::string_view s) noexcept {
+            return sizeof(std::uint32_t) + s.size();
+         }
+         static unsigned char* encode(unsigned char* p, std::string_view s) noexcept {
+            const auto n = static_cast<std::uint32_t>(s.size());
+            std::memcpy(p, &n, sizeof(n));
+            std::memcpy(p + sizeof(n), s.data(), n);
+            return p + sizeof(n) + n;
+         }
+         static const unsigned char* decode(const unsigned char* p, std::ostream& os) {
+            std::uint32_t n;
+            std::memcpy(&n, p, sizeof(n));
+            os.write(reinterpret_cast<const char*>(p + sizeof(n)), n);
+            return p + sizeof(n) + n;
+         }
+      };
+
+      template <typename T>
+      struct codec<T, std::enable_if_t<std::is_pointer_v<T> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>>> : string_codec {};
+      template <>
+      struct codec<std::string> : string_codec {};
+      template <>
+      struct codec<std::string_view> : string_codec {};
+
+      /**
+         Writes 'fmt' to 'os' up to the next placeholder '%' ("%%" is a plain '%')
+         \return the rest of 'fmt' after the placeholder, nullptr if there is none
+      */
+      inline const char* format_until_placeholder(std::ostream& os, const char* fmt) {
+         while(fmt && *fmt) {
+            if(*fmt=='%') {
+               if(fmt[1]!='%')
+                  return fmt+1;
+               ++fmt;
+            }
+            os.put(*fmt++);
+         }
+         return nullptr;
+      }
+
+      /**
+         The format descriptor of a record, one per list of argument types, its address identifies the decoder
+      */
+      struct descriptor {
+         void (*format)(std::ostream& os, const char* fmt, const unsigned char* args);
+      };
+
+      template <typename... Args>
+      void format_record(std::ostream& os, const char* fmt, [[maybe_unused]] const unsigned char* args) {
+         ([&] {
+            if(fmt) {
+               fmt = format_until_placeholder(os, fmt);
+               if(!fmt)
+                  os.put(' ');   // <-- an extra argument is appended
+            }
+            else
+               os.put(' ');
+            args = codec<Args>::decode(args, os);
+         }(), ...);
+         while((fmt = format_until_placeholder(os, fmt)))
+            os.put('%');   // <-- a missing argument, the placeholder is written as is
+      }
+
+      template <typename... Args>
+      inline constexpr descriptor descriptor_of{&format_record<Args...>};
+
+      /**
+         The payload of a record: the descriptor, the format string, the stamp and the encoded arguments
+      */
+      struct record_prefix {
+         const descriptor*   d;
+         const char*         fmt;
+         stamp               s;
+      };
+
+      /**
+         The ring, the queues of parallel::printf and the thread which drains them to the sink.
+         Popped lines are held until they are older than the reorder window and written in the order of their stamps,
+         so lines of different threads (and the lines of parallel::cout and parallel::printf of one thread) come out
+         in the order they were made unless a line is published later than the window after it is stamped.
+      */
+      class flusher {
+         static constexpr std::size_t batch_bytes = 64*1024;
+         static constexpr std::size_t held_bytes  = 1024*1024;   // more held text than that is written regardless of the window
+
+         using queue_ptr = std::shared_ptr<record_queue>;
+
+         /**
+            A popped line waiting for the reorder window
+         */
+         struct held_line {
+            stamp         s;
+            std::size_t   off;    // of its text in held_text_
+            std::size_t   size;
+            std::size_t   mark;   // of a record: a predecessor of the same thread may still be in the ring before this position
+         };
+
+         line_ring                     ring_;
+         std::shared_ptr<sink>         sink_;
+         std::mutex                    sink_m_;
+         std::atomic<std::uint64_t>    window_;   // in clock ticks
+         std::atomic<bool>             show_stamps_{false};
+         std::atomic<std::size_t>      flush_req_{0};   // the last ticket of flush()
+         std::atomic<std::size_t>      flushed_{0};     // the last ticket served
+         enum : int { awake, waiting, holding };
+         std::atomic<int>              sleeping_{awake};   // holding - waits for held lines to become due, a new line need not wake it
+         std::atomic<bool>             done_{false};
+         std::atomic<std::size_t>      waits_{0};
+         std::atomic<std::int64_t>     wait_ns_{0};
+         std::atomic<overflow>         overflow_{overflow::block};
+         std::shared_ptr<sink>         spill_;
+         std::mutex                    spill_m_;
+         std::mutex                    pop_m_;   // the flusher pops the ring under it, a producer of overflow::drop_oldest drops under it
+         std::atomic<std::size_t>      dropped_{0};
+         std::atomic<std::size_t>      spilled_{0};
+         std::atomic<std::size_t>      direct_{0};    // lines too long for the ring, written by their producers
+         std::atomic<std::size_t>      written_{0};   // by the flusher
+         std::atomic<std::size_t>      ring_high_{0};    // slots
+         std::atomic<std::size_t>      queue_high_{0};   // bytes
+         std::mutex                    m_;
+         std::condition_variable       cv_;
+         std::mutex                    queues_m_;
+         std::vector<queue_ptr>        queues_;
+         std::size_t                   retired_records_{0};   // of the queues removed from queues_
+         std::atomic<std::size_t>      generation_{0};   // changes with queues_
+
+         // the flusher thread only
+         std::vector<std::uint32_t>    next_seq_;   // of every thread, the seq of its next line to write
+         std::vector<queue_ptr>        queues_seen_;
+         std::size_t                   generation_seen_{~std::size_t{0}};
+         std::vector<held_line>        held_;
+         std::size_t                   ring_due_{0};   // the ring is popped up to here even if held_bytes are held, a held record waits for it
+         std::string                   held_text_;
+         std::string                   spare_text_;
+         std::string                   batch_;
+         line_buffer                   buf_;
+         std::ostream                  os_{&buf_};
+
+         std::thread                   thread_;
+
+         void write_out(std::string_view text) {
+            std::lock_guard<std::mutex> l{sink_m_};
+            try {
+               sink_->write(text);
+            }
+            catch(...) {
+               // <-- e.g. a file cannot be rotated, nowhere to report it from the flusher
+            }
+         }
+
+         /**
+            \param urgent  a producer waits for space or for a flush, otherwise a holding flusher is left asleep
+         */
+         void wake(bool urgent = true) {
+            const auto state = sleeping_.load(std::memory_order_seq_cst);
+            if(state==awake || (state==holding && !urgent))
+               return;
+            if(sleeping_.exchange(awake, std::memory_order_seq_cst)!=awake) {   // <-- the first one notifies
+               std::lock_guard<std::mutex> l{m_};
+               cv_.notify_one();
+            }
+         }
+
+         /**
+            Appends "<seconds since start> t<thread>#<seq> "
+         */
+         static void append_stamp(std::string& out, const stamp& s) {
+            const auto ns = static_cast<unsigned long long>(tick_clock::calibrated().since_start(s.ticks).count());
+            char text[64];
+            const auto n = std::snprintf(text, sizeof(text), "%llu.%09llu t%u#%u ", ns/1000000000u, ns%1000000000u,
+                                         static_cast<unsigned>(s.thread), static_cast<unsigned>(s.seq));
+            out.append(text, static_cast<std::size_t>(std::max(n, 0)));
+         }
+
+         void refresh_queues() {
+            if(generation_seen_==generation_.load(std::memory_order_acquire))
+               return;
+            std::lock_guard<std::mutex> l{queues_m_};
+            const auto retired = std::partition(queues_.begin(), queues_.end(), [](const queue_ptr& q) { return !(q->orphaned() && q->empty()); });
+            for(auto it = retired; it!=queues_.end(); ++it)
+               retired_records_ += (*it)->records();
+            queues_.erase(retired, queues_.end());
+            queues_seen_    = queues_;
+            generation_seen_ = generation_.load(std::memory_order_relaxed);
+         }
+
+         static void raise(std::atomic<std::size_t>& high, std::size_t value) noexcept {
+            if(value>high.load(std::memory_order_relaxed))
+               high.store(value, std::memory_order_relaxed);   // <-- the flusher is the only writer
+         }
+
+         /**
+            Formats records of 'q' into held lines
+         */
+         bool collect_queue(record_queue& q) {
+            raise(queue_high_, q.committed() - q.released());
+            const auto flags     = os_.flags();
+            const auto precision = os_.precision();
+            const auto first     = held_.size();
+            while((held_text_.size()<held_bytes || q.due()) && q.pop([&](const unsigned char* payload) {
+               record_prefix r;
+               std::memcpy(&r, payload, sizeof(r));
+               buf_.clear();
+               r.d->format(os_, r.fmt, payload + sizeof(r));
+               os_.flags(flags);
+               os_.precision(precision);
+               held_.push_back({r.s, held_text_.size(), buf_.view().size(), 0});
+               held_text_.append(buf_.view());
+            }));
+            if(first==held_.size())
+               return false;
+            const auto mark = ring_.reserved();   // <-- a line of the ring which precedes a record was reserved before the record was committed
+            for(auto i = first; i<held_.size(); ++i)
+               held_[i].mark = mark;
+            return true;
+         }
+
+         /**
+            Pops published lines and records into held lines until held_bytes are held, the space of the records is freed right away.
+            A record made before a popped line is popped in the same pass regardless of held_bytes, so a held line of the ring
+            never waits for a predecessor: it is held already, or it is dropped.
+            \return false if there was nothing to pop
+         */
+         bool collect() {
+            bool any{false};
+            for(bool more{true}; more;) {
+               more = false;
+               stamp s;
+               {
+                  std::lock_guard<std::mutex> l{pop_m_};
+                  raise(ring_high_, ring_.reserved() - ring_.popped());
+                  for(auto off = held_text_.size(); (held_text_.size()<held_bytes || ring_.popped()<ring_due_) && ring_.try_pop(s, held_text_); off = held_text_.size()) {
+                     held_.push_back({s, off, held_text_.size()-off, 0});
+                     more = true;
+                  }
+               }
+               const bool popped = more;
+               refresh_queues();   // <-- even from a new queue
+               for(auto& q : queues_seen_) {
+                  if(popped)
+                     q->make_due();
+                  more |= collect_queue(*q);
+                  q->release();
+               }
+               any |= more;
+            }
+            if(std::any_of(queues_seen_.begin(), queues_seen_.end(), [](const queue_ptr& q) { return q->orphaned() && q->empty(); }))
+               generation_.fetch_add(1, std::memory_order_release);   // <-- drop it next time
+            return any;
+         }
+
+         std::uint32_t& next_seq(std::uint32_t thread) {
+            if(thread>=next_seq_.size())
+               next_seq_.resize(thread+1, 0);
+            return next_seq_[thread];
+         }
+
+         /**
+            Writes held lines in the order of their stamps by as few calls of the sink as possible:
+            those older than the reorder window (any of them if held_bytes are held) up to the first record
+            whose predecessor of the same thread is missing and may still be in the ring (it is being copied in,
+            behind a line of another thread, or collect() has stopped at held_bytes) or, if 'all', every one of them
+         */
+         void emit(bool all) {
+            if(held_.empty())
+               return;
+            std::sort(held_.begin(), held_.end(), [](const held_line& a, const held_line& b) { return a.s<b.s; });
+            auto end = held_.end();
+            if(!all) {
+               const bool full = held_text_.size()>=held_bytes;
+               if(!full) {
+                  const auto now    = tick_clock::now();
+                  const auto window = window_.load(std::memory_order_relaxed);
+                  const auto due    = now>window? now-window : 0;
+                  end = std::upper_bound(held_.begin(), held_.end(), due, [](std::uint64_t t, const held_line& l) { return t<l.s.ticks; });
+               }
+               const auto popped = ring_.popped();
+               auto it = held_.begin();
+               for(; it!=end; ++it) {
+                  auto& next = next_seq(it->s.thread);
+                  if(next!=it->s.seq && popped<it->mark) {
+                     ring_due_ = std::max(ring_due_, it->mark);
+                     break;
+                  }
+                  next = it->s.seq+1;
+               }
+               end = it;
+            }
+            if(end==held_.begin())
+               return;
+            written_.fetch_add(static_cast<std::size_t>(end - held_.begin()), std::memory_order_relaxed);
+            const bool stamps = show_stamps_.load(std::memory_order_relaxed);
+            for(auto it = held_.begin(); it!=end; ++it) {
+               next_seq(it->s.thread) = it->s.seq+1;
+               if(stamps)
+                  append_stamp(batch_, it->s);
+               batch_.append(held_text_, it->off, it->size);
+               if(batch_.size()>=batch_bytes) {
+                  write_out(batch_);
+                  batch_.clear();
+               }
+            }
+            if(!batch_.empty()) {
+               write_out(batch_);
+               batch_.clear();
+            }
+            spare_text_.clear();
+            for(auto it = end; it!=held_.end(); ++it) {
+               const auto off = spare_text_.size();
+               spare_text_.append(held_text_, it->off, it->size);
+               it->off = off;
+            }
+            held_.erase(held_.begin(), end);
+            held_text_.swap(spare_text_);
+         }
+
+         /**
+            Writes every line and record published before 'ticket' was taken, regardless of the window
+         */
+         void serve_flush(std::size_t ticket) {
+            refresh_queues();
+            const auto target = ring_.reserved();
+            std::vector<std::pair<record_queue*, std::size_t>> targets;
+            for(auto& q : queues_seen_)
+               targets.emplace_back(q.get(), q->committed());
+            const auto reached = [&] {
+               return ring_.popped()>=target
+                   && std::all_of(targets.begin(), targets.end(), [](const auto& t) { return t.first->popped()>=t.second; });
+            };
+            while(!reached()) {
+               if(!collect())
+                  std::this_thread::yield();   // <-- a line is being copied in
+               if(held_text_.size()>=held_bytes)
+                  emit(false);
+            }
+            emit(true);
+            flushed_.store(ticket, std::memory_order_release);
+         }
+
+         bool idle() {
+            if(ring_.reserved()!=ring_.popped())
+               return false;
+            std::lock_guard<std::mutex> l{queues_m_};
+            return std::all_of(queues_.begin(), queues_.end(), [](const queue_ptr& q) { return q->empty(); });
+         }
+
+         void run() {
+            using namespace std::chrono_literals;
+            batch_.reserve(batch_bytes + ring_.max_line());
+            held_text_.reserve(held_bytes + ring_.max_line());
+            spare_text_.reserve(held_bytes + ring_.max_line());
+            for(;;) {
+               refresh_queues();
+               const auto ticket = flush_req_.load(std::memory_order_acquire);
+               if(ticket!=flushed_.load(std::memory_order_relaxed)) {
+                  serve_flush(ticket);
+                  continue;
+               }
+               const bool any = collect();
+               emit(false);
+               if(any)
+                  continue;
+               if(done_.load(std::memory_order_acquire)) {
+                  if(idle()) {
+                     emit(true);
+                     return;
+                  }
+                  std::this_thread::yield();   // <-- a line is being copied in
+                  continue;
+               }
+               auto timeout = std::chrono::nanoseconds{10ms};   // <-- the timeout bounds a lost wake-up, e.g. of a line which was being copied in
+               if(!held_.empty()) {
+                  const auto due = held_.front().s.ticks + window_.load(std::memory_order_relaxed);
+                  const auto now = tick_clock::now();
+                  timeout = std::min(timeout, tick_clock::calibrated().duration(due>now? due-now : 0) + 1us);
+               }
+               std::unique_lock<std::mutex> l{m_};
+               const auto state = held_.empty()? waiting : holding;
+               sleeping_.store(state, std::memory_order_seq_cst);
+               if(flush_req_.load(std::memory_order_seq_cst)==flushed_.load(std::memory_order_relaxed)
+                  && (state==holding || (ring_.reserved()==ring_.popped() && generation_seen_==generation_.load(std::memory_order_acquire))))
+                  cv_.wait_for(l, timeout);   // <-- new lines are collected when the held ones are due
+               sleeping_.store(awake, std::memory_order_relaxed);
+            }
+         }
+
+         /**
+            The queue of the calling thread, it is created on first use and orphaned when the thread exits
+         */
+         record_queue& local_queue() {
+            struct holder_t {
+               queue_ptr q;
+               ~holder_t() {
+                  if(q)
+                     q->orphan();
+               }
+            };
+            thread_local holder_t holder;
+            if(!holder.q) {
+               holder.q = std::make_shared<record_queue>(64*1024);
+               std::lock_guard<std::mutex> l{queues_m_};
+               queues_.push_back(holder.q);
+               generation_.fetch_add(1, std::memory_order_release);
+            }
+            return *holder.q;
+         }
+
+         template <typename F>
+         void wait_for_space(unsigned spins, F&& retry) {
+            if(retry())
+               return;
+            const auto start = std::chrono::steady_clock::now();   // <-- the slow path only, a statement which fits costs no clock read
+            do {
+               wake();
+               if(spins++<64)
+                  std::this_thread::yield();
+               else
+                  std::this_thread::sleep_for(std::chrono::microseconds{50});
+            } while(!retry());
+            waits_.fetch_add(1, std::memory_order_relaxed);
+            wait_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count(), std::memory_order_relaxed);
+         }
+
+         void spill(const stamp& s, std::string_view line) {
+            std::string text;
+            if(show_stamps_.load(std::memory_order_relaxed))
+               append_stamp(text, s);
+            text.append(line);
+            std::lock_guard<std::mutex> l{spill_m_};
+            try {
+               if(spill_) {
+                  spill_->write(text);
+                  spilled_.fetch_add(1, std::memory_order_relaxed);
+                  return;
+               }
+            }
+            catch(...) {
+               // <-- as of write_out(), the line is lost
+            }
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+         }
+
+         /**
+            The ring is full: handles the line by the overflow policy,
+            a line which gets in after all is stamped anew, so that its wait does not count against the reorder window
+            \return true if it is pushed after all
+         */
+         bool push_overflow(stamp s, std::string_view line) {
+            const auto retry = [&] {
+               s.ticks = tick_clock::now();
+               return ring_.try_push(s, line);
+            };
+            switch(overflow_.load(std::memory_order_relaxed)) {
+            case overflow::block:
+               wait_for_space(0, retry);
+               return true;
+            case overflow::drop_newest:
+               dropped_.fetch_add(1, std::memory_order_relaxed);
+               wake();
+               return false;
+            case overflow::drop_oldest:
+               do {
+                  bool dropped{false};
+                  {
+                     std::unique_lock<std::mutex> l{pop_m_, std::try_to_lock};
+                     dropped = l.owns_lock() && ring_.try_drop();
+                  }
+                  if(dropped)
+                     dropped_.fetch_add(1, std::memory_order_relaxed);
+                  else {
+                     wake();
+                     std::this_thread::yield();   // <-- the flusher is popping, or the oldest line is being copied in
+                  }
+               } while(!retry());
+               return true;
+            case overflow::spill:
+               spill(s, line);
+               wake();
+               return false;
+            }
+            return false;
+         }
+
+      public:
+         explicit flusher(int fd = 1, std::size_t slots = 4096)
+            : ring_(slots), sink_(std::make_shared<console_sink>(fd)),
+              window_(tick_clock::calibrated().ticks(std::chrono::milliseconds{1})), thread_(&flusher::run, this) {}
+
+         ~flusher() {
+            done_.store(true, std::memory_order_release);
+            {
+               std::lock_guard<std::mutex> l{m_};
+               cv_.notify_one();
+            }
+            thread_.join();
+         }
+
+         flusher(const flusher&) = delete;
+         flusher& operator=(const flusher&) = delete;
+
+         static flusher& instance() {
+            static flusher f;
+            return f;
+         }
+
+         /**
+            Stamps and pushes a completed line, waits (without locks) only if the ring is full
+         */
+         void push(std::string_view line) {
+            if(line.size()>ring_.max_line()) {
+               flush();
+               std::string text;
+               if(show_stamps_.load(std::memory_order_relaxed))
+                  append_stamp(text, stamp::now());
+               text.append(line);
+               write_out(text);
+               direct_.fetch_add(1, std::memory_order_relaxed);
+               return;
+            }
+            const auto s = stamp::next();
+            if(ring_.try_push(s, line) || push_overflow(s, line))
+               wake(false);
+         }
+
+         /**
+            Reserves a record of 'n' bytes in the queue of the calling thread, waits only if the queue is full and overflow::block
+            \return nullptr if a record that large does not fit into the queue at all, or it is full and the policy is not to block
+                    (the statement is formatted by the calling thread and pushed into the ring, where the policy applies)
+         */
+         unsigned char* reserve(std::size_t n) {
+            auto& q = local_queue();
+            if(n>q.max_payload())
+               return nullptr;
+            unsigned char* p = q.reserve(n);
+            if(p || overflow_.load(std::memory_order_relaxed)!=overflow::block)
+               return p;
+            wait_for_space(0, [&] { return (p = q.reserve(n))!=nullptr; });
+            return p;
+         }
+         void commit() {
+            local_queue().commit();
+            wake(false);
+         }
+
+         /**
+            Lines pushed before the call go to the previous sink, the rest to 's'
+         */
+         void set_sink(std::shared_ptr<sink> s) {
+            flush();
+            std::lock_guard<std::mutex> l{sink_m_};
+            sink_ = s? std::move(s) : std::make_shared<console_sink>();
+         }
+
+         void set_reorder_window(std::chrono::nanoseconds window) {
+            window_.store(tick_clock::calibrated().ticks(window), std::memory_order_relaxed);
+         }
+         void show_stamps(bool on) noexcept {
+            show_stamps_.store(on, std::memory_order_relaxed);
+         }
+
+         void set_overflow(overflow policy, std::shared_ptr<sink> spill) {
+            if(policy==overflow::spill && !spill)
+               throw std::invalid_argument{"parallel::set_overflow: overflow::spill needs a sink"};
+            {
+               std::lock_guard<std::mutex> l{spill_m_};
+               spill_ = std::move(spill);
+            }
+            overflow_.store(policy, std::memory_order_relaxed);
+         }
+
+         statistics stats() {
+            std::size_t records{0};
+            {
+               std::lock_guard<std::mutex> l{queues_m_};
+               records = retired_records_;
+               for(const auto& q : queues_)
+                  records += q->records();
+            }
+            const auto direct = direct_.load(std::memory_order_relaxed);
+            return {waits_.load(std::memory_order_relaxed), std::chrono::nanoseconds{wait_ns_.load(std::memory_order_relaxed)}, 0,
+                    ring_.lines() + records + direct,
+                    dropped_.load(std::memory_order_relaxed),
+                    spilled_.load(std::memory_order_relaxed),
+                    written_.load(std::memory_order_relaxed) + direct,
+                    ring_high_.load(std::memory_order_relaxed) * line_ring::slot_bytes,
+                    queue_high_.load(std::memory_order_relaxed)};
+         }
+
+         /**
+            Waits until every line and record pushed before the call is written, the reorder window is not waited for
+         */
+         void flush() {
+            const auto ticket = flush_req_.fetch_add(1, std::memory_order_seq_cst) + 1;
+            while(flushed_.load(std::memory_order_acquire)<ticket) {
+               wake();
+               std::this_thread::yield();
+            }
+         }
+      };
+   }  // namespace detail
+
+   namespace detail
+   {
+      /**
+         A std::ostream with its buffer which a thread reuses for all of its statements,
+         the stream (and its locale) is constructed once per thread rather than once per line
+      */
+      class line_stream {
+         line_buffer                buf_;
+         std::ostream               os_{&buf_};
+         std::ios_base::fmtflags    flags_{os_.flags()};
+         std::streamsize            precision_{os_.precision()};
+         char                       fill_{os_.fill()};
+
+         line_stream() = default;
+
+         struct stack_t {
+            std::vector<std::unique_ptr<line_stream>>   streams;
+            std::size_t                                 depth{0};
+         };
+         static stack_t& stack() {
+            thread_local stack_t s;
+            return s;
+         }
+
+      public:
+         /**
+            \return the stream of the calling thread for a new statement,
+                    a statement nested in another one (e.g. logging inside an argument) gets a stream of its own
+         */
+         static line_stream& acquire() {
+            auto& s = stack();
+            if(s.depth==s.streams.size())
+               s.streams.emplace_back(new line_stream);
+            auto& ls = *s.streams[s.depth++];
+            ls.buf_.clear();
+            ls.os_.clear();
+            ls.os_.flags(ls.flags_);
+            ls.os_.precision(ls.precision_);
+            ls.os_.width(0);
+            ls.os_.fill(ls.fill_);
+            return ls;
+         }
+         static void release() noexcept {
+            --stack().depth;
+         }
+
+         std::ostream& stream() noexcept {
+            return os_;
+         }
+         std::string_view view() const noexcept {
+            return buf_.view();
+         }
+      };
+   }  // namespace detail
+
+   namespace detail
+   {
+      /**
+         A stream without a buffer, it ignores everything (of a statement which is filtered out)
+      */
+      inline std::ostream& null_stream() {
+         thread_local std::ostream os{nullptr};
+         return os;
+      }
+
+      /**
+         A statement is formatted into a thread-local buffer which is reused,
+         so in the steady state a line costs no heap allocation at all.
+         A statement which is not admitted takes no buffer and writes nothing.
+      */
+      class statement {
+         line_stream* ls_;
+      public:
+         explicit statement(bool admitted = true) : ls_(admitted? &line_stream::acquire() : nullptr) {}
+         ~statement() {
+            if(!ls_)
+               return;
+            try {
+               flusher::instance().push(ls_->view());
+            }
+            catch(...) {
+               // <-- a destructor must not throw, a lost line is the lesser evil
+            }
+            line_stream::release();
+         }
+         statement(const statement&) = delete;
+         statement& operator=(const statement&) = delete;
+
+         explicit operator bool() const noexcept {
+            return ls_!=nullptr;
+         }
+         std::ostream& stream() noexcept {
+            return ls_? ls_->stream() : null_stream();
+         }
+      };
+
+      /**
+         Thins out the statements of a level at run time:
+            sampling    - every thread keeps 1 of every 'n' of its statements,
+            rate limit  - at most 'lines' per period over all threads, by the generic cell rate algorithm:
+                          a line is kept unless it runs ahead of the schedule of one line per 'interval' by more than the burst.
+         Unless one of them is set, a statement costs two relaxed loads.
+      */
+      class level_filter {
+         std::atomic<std::uint32_t>   every_{1};
+         std::atomic<std::uint64_t>   interval_{0};    // ticks per line, 0 - no limit
+         std::atomic<std::uint64_t>   tolerance_{0};   // ticks a line may run ahead of the schedule
+         std::atomic<std::uint64_t>   tat_{0};         // when the next line is due by the schedule
+         std::atomic<std::size_t>     filtered_{0};
+
+         bool drop() noexcept {
+            filtered_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+         }
+
+      public:
+         /**
+            \param count  statements of the calling thread at this level so far
+         */
+         bool admit(std::uint32_t& count) noexcept {
+            const auto every = every_.load(std::memory_order_relaxed);
+            if(every>1 && count++ % every!=0)
+               return drop();
+            const auto interval = interval_.load(std::memory_order_relaxed);
+            if(interval==0)
+               return true;
+            const auto now       = tick_clock::now();
+            const auto tolerance = tolerance_.load(std::memory_order_relaxed);
+            auto tat = tat_.load(std::memory_order_relaxed);
+            for(;;) {
+               const auto due = std::max(tat, now);
+               if(due-now > tolerance)
+                  return drop();
+               if(tat_.compare_exchange_weak(tat, due+interval, std::memory_order_relaxed))
+                  return true;
+            }
+         }
+
+         void sample(unsigned n) noexcept {
+            every_.store(std::max(n, 1u), std::memory_order_relaxed);
+         }
+         void rate_limit(std::size_t lines, std::chrono::nanoseconds period) {
+            const auto interval = lines? std::max<std::uint64_t>(1, tick_clock::calibrated().ticks(period) / lines) : 0;
+            tolerance_.store(lines? interval*(lines-1) : 0, std::memory_order_relaxed);
+            tat_.store(0, std::memory_order_relaxed);
+            interval_.store(interval, std::memory_order_relaxed);
+         }
+         std::size_t filtered() const noexcept {
+            return filtered_.load(std::memory_order_relaxed);
+         }
+      };
+
+      inline level_filter& filter(level l) noexcept {
+         static level_filter filters[static_cast<int>(level::error)+1];
+         return filters[static_cast<int>(l)];
+      }
+
+      /**
+         \return false if the statement of level 'L' is filtered out (always if the level is disabled)
+      */
+      template <level L>
+      bool admit() noexcept {
+         if constexpr(!enabled<L>)
+            return false;
+         else {
+            thread_local std::uint32_t count{0};
+            return filter(L).admit(count);
+         }
+      }
+   }  // namespace detail
+
+   /**
+      A statement of level 'L' (info by default), it is formatted into a thread-local buffer which is reused,
+      so in the steady state a line costs no heap allocation at all.
+      A statement below PARALLEL_COUT_LEVEL is an empty object, the optimizer removes it together with the insertions,
+      but not the evaluation of their arguments - PARALLEL_COUT(level) skips that too.
+
+      Usage Example:
+         parallel::cout{} << "[" << n << "]: " << s << endl;
+         parallel::cout<parallel::level::debug>{} << "cheap " << n << endl;
+         PARALLEL_COUT(debug) << "costly " << dump(graph) << endl;   // <-- dump() is not called unless the line is written
+   */
+   template <level L = level::info>
+   class cout {
+      detail::statement s_;
+   public:
+      cout() : s_(detail::admit<L>()) {}
+      cout(const cout&) = delete;
+      cout& operator=(const cout&) = delete;
+
+      /**
+         \return false if the statement is filtered out, i.e. it writes nothing
+      */
+      explicit operator bool() const noexcept {
+         return static_cast<bool>(s_);
+      }
+
+      template <typename T>
+      cout& operator<<(T&& v) {
+         if constexpr(enabled<L>)
+            if(s_)
+               s_.stream() << std::forward<T>(v);
+         return *this;
+      }
+      cout& operator<<(std::ostream& (*manip)(std::ostream&)) {
+         if constexpr(enabled<L>)
+            if(s_)
+               manip(s_.stream());
+         return *this;
+      }
+      cout& operator<<(std::ios_base& (*manip)(std::ios_base&)) {
+         if constexpr(enabled<L>)
+            if(s_)
+               manip(s_.stream());
+         return *this;
+      }
+
+      /**
+         \return the underlying stream, e.g. for a function which takes std::ostream&
+      */
+      std::ostream& stream() {
+         return s_.stream();
+      }
+   };
+
+   namespace detail
+   {
+      /**
+         parallel::printf of an admitted statement.
+         The flusher formats the line later from the stored 'fmt' pointer, so 'fmt' must be an array which lives as long as the program:
+         a std::string::c_str() does not compile, a writable buffer is rejected by the deleted overload below.
+      */
+      template <std::size_t N, typename... Args>
+      void print(const char (&fmt)[N], const Args&... args) {
+         auto& f = flusher::instance();
+         const auto bytes = sizeof(record_prefix) + (std::size_t{0} + ... + codec<std::decay_t<Args>>::size(args));
+         auto* p = f.reserve(bytes);
+         if(!p) {
+            statement line;   // <-- too large for a record, formatted right here
+            std::string args_bytes(bytes, '\0');
+            [[maybe_unused]] auto* a = reinterpret_cast<unsigned char*>(args_bytes.data()) + sizeof(record_prefix);
+            ((a = codec<std::decay_t<Args>>::encode(a, args)), ...);
+            format_record<std::decay_t<Args>...>(line.stream(), fmt, reinterpret_cast<const unsigned char*>(args_bytes.data()) + sizeof(record_prefix));
+            return;
+         }
+         const record_prefix r{&descriptor_of<std::decay_t<Args>...>, fmt, stamp::next()};
+         std::memcpy(p, &r, sizeof(r));
+         p += sizeof(r);
+         ((p = codec<std::decay_t<Args>>::encode(p, args)), ...);
+         f.commit();
+      }
+
+      template <std::size_t N, typename... Args>
+      void print(char (&fmt)[N], const Args&... args) = delete;   // <-- a buffer may be rewritten or gone by the time the line is formatted
+   }  // namespace detail
+
+   /**
+      Deferred formatting: the calling thread only copies the raw bytes of 'args' and the id of a format descriptor
+      into a queue of its own, the text is formatted by the flusher thread.
+      \param fmt   a string literal, '%' is a placeholder for the next argument, "%%" is a plain '%';
+                   it is formatted later by the flusher, so a std::string::c_str() or a char buffer does not compile
+      \param args  arithmetic types, enums, pointers and strings (which are copied)
+      \tparam L    the level, as of parallel::cout
+
+      Usage Example:
+         parallel::printf("[%]: % took % ms\n", n, name, 3.14);
+         parallel::printf<parallel::level::debug>("queue %\n", q.size());
+         PARALLEL_PRINTF(debug, "queue %\n", q.size());   // <-- q.size() is not called unless the line is written
+   */
+   template <level L = level::info, std::size_t N, typename... Args>
+   void printf(const char (&fmt)[N], const Args&... args) {
+      if constexpr(enabled<L>)
+         if(detail::admit<L>())
+            detail::print(fmt, args...);
+   }
+
+   template <level L = level::info, std::size_t N, typename... Args>
+   void printf(char (&fmt)[N], const Args&... args) = delete;
+
+   /**
+      Keeps 1 of every 'n' statements of level 'l' on every thread (1 keeps all of them)
+   */
+   inline void sample(level l, unsigned n) {
+      detail::filter(l).sample(n);
+   }
+
+   /**
+      Keeps at most 'lines' statements of level 'l' per 'period' over all threads, they may come in a burst (0 - no limit)
+
+      Usage Example:
+         parallel::rate_limit(parallel::level::debug, 1000);   // <-- a flood of debug lines cannot swamp the sink
+   */
+   inline void rate_limit(level l, std::size_t lines, std::chrono::nanoseconds period = std::chrono::seconds{1}) {
+      detail::filter(l).rate_limit(lines, period);
+   }
+
+   /**
+      Redirects parallel::cout and parallel::printf to 's' (stdout if it is nullptr),
+      lines pushed before the call are written to the previous sink
+
+      Usage Example:
+         parallel::set_sink(std::make_shared<parallel::mmap_file_sink>("app.log", 256*1024*1024, 8));
+   */
+   inline void set_sink(std::shared_ptr<sink> s) {
+      detail::flusher::instance().set_sink(std::move(s));
+   }
+
+   /**
+      Lines are held by the flusher for 'window' (1 ms by default) and written in the order of their stamps,
+      a longer window tolerates longer delays between stamping a line and publishing it, e.g. a preempted thread,
+      at the cost of latency; zero writes lines as they come (still sorted within a batch)
+   */
+   inline void set_reorder_window(std::chrono::nanoseconds window) {
+      detail::flusher::instance().set_reorder_window(window);
+   }
+
+   /**
+      Prefixes every line with its stamp: "<seconds since start> t<thread>#<seq> ",
+      the thread numbers are assigned by the first line of every thread, seq counts the lines of the thread
+   */
+   inline void show_stamps(bool on = true) {
+      detail::flusher::instance().show_stamps(on);
+   }
+
+   /**
+      What a statement does when the ring is full, see parallel::overflow.
+      A queue of parallel::printf which is full blocks under overflow::block, otherwise its statement is formatted
+      by the calling thread and goes to the ring. A line dropped from the ring is counted in parallel::stats().dropped.
+      \param spill  the sink of overflow::spill, written by the logging threads under a lock of its own
+
+      Usage Example:
+         parallel::set_overflow(parallel::overflow::drop_oldest);   // <-- request threads never wait for a slow disk
+         parallel::set_overflow(parallel::overflow::spill, std::make_shared<parallel::mmap_file_sink>("spill.log"));
+   */
+   inline void set_overflow(overflow policy, std::shared_ptr<sink> spill = nullptr) {
+      detail::flusher::instance().set_overflow(policy, std::move(spill));
+   }
+
+   /**
+      \return counters of parallel::cout and parallel::printf since the start of the program
+   */
+   inline statistics stats() {
+      auto s = detail::flusher::instance().stats();
+      for(int l{0}; l<=static_cast<int>(level::error); ++l)
+         s.filtered += detail::filter(static_cast<level>(l)).filtered();
+      return s;
+   }
+
+   /**
+      Waits until every line of parallel::cout and parallel::printf pushed so far is written to the sink
+   */
+   inline void flush() {
+      detail::flusher::instance().flush();
+   }
+
+}  // end namespace parallel
+
+/**
+   A statement of a level (a name of parallel::level) whose arguments are evaluated only if the line is written:
+   a disabled level is discarded at compile time, a filtered out statement is skipped at run time.
+   It is a single if-else statement, so it nests safely in an if-else of the caller.
+*/
+#define PARALLEL_COUT(L) \
+   if constexpr(!::parallel::enabled<::parallel::level::L>) {} \
+   else if(::parallel::cout<::parallel::level::L> parallel_cout_statement_; !parallel_cout_statement_) {} \
+   else parallel_cout_statement_
+
+#define PARALLEL_PRINTF(L, ...) \
+   do { \
+      if constexpr(::parallel::enabled<::parallel::level::L>) \
+         if(::parallel::detail::admit<::parallel::level::L>()) \
+            ::parallel::detail::print(__VA_ARGS__); \
+   } while(false)
+
+#endif // _PARALLEL_COUT_H__
@@ -0,0 +1,208 @@
+#if !defined(_PDAG_ALGORITHM_H__)
+#define _PDAG_ALGORITHM_H__
+
+#include "cancellation.h"
+#include "executor.h"
+#include "future.h"
+#include "pdag.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+   Data-parallel DAG stages over a large std::vector.
+   A node of asynchronize/async_adapter is either one giant task or, if the range is split by hand, a million tiny ones.
+   parallel_map/parallel_reduce split the input into cache-sized chunks, run the chunks on the pool
+   and publish the combined result as an ordinary node future for downstream stages.
+
+   Usage Example:
+      auto pgen    = asynchronize(generate, pool);                      // node<vector<double>>
+      auto psquare = parallel_map([](double x) { return x*x; }, pool);   // vector<double> -> vector<double>
+      auto psum    = parallel_reduce(std::plus<>{}, 0., pool);         // vector<double> -> double
+
+      auto res = pconcat(..., psum(psquare(pgen(1'000'000))));
+
+   Note:
+      - a chunk holds 'chunk_bytes' of the input (or of the output, whichever element is larger),
+        the default fits L2 of a core, so a chunk is read and written while it is hot;
+      - parallel_map requires a default constructible result, it is written in place;
+      - parallel_reduce requires an associative 'op' and elements of the type of 'init', partial results are combined in the order of chunks;
+      - a failed chunk cancels the rest, the result holds its exception;
+      - these nodes are not memoized (see memo.h).
+*/
+
+namespace pdag
+{
+   namespace detail
+   {
+      constexpr std::size_t default_chunk_bytes = 256*1024;
+
+      inline std::size_t chunk_items(std::size_t chunk_bytes, std::size_t item_bytes) noexcept {
+         return std::max<std::size_t>(1, chunk_bytes / std::max<std::size_t>(1, item_bytes));
+      }
+
+      /**
+         Runs body(i, first, last) for chunks [first,last) of [0,n) on 'ex' and then done(error) once,
+         the last chunk is executed by the calling thread. It never blocks.
+      */
+      template <typename Body, typename Done>
+      void for_each_chunk(executor& ex, std::size_t n, std::size_t chunk, const cancellation_token& ct, Body body, Done done) {
+         struct state_t {
+            Body                       body;
+            Done                       done;
+            cancellation_token         ct;
+            std::atomic<std::size_t>   left;
+            std::atomic<bool>          failed{false};
+            std::mutex                 m;
+            std::exception_ptr         error;
+
+            state_t(Body body, Done done, cancellation_token ct, std::size_t chunks)
+               : body(std::move(body)), done(std::move(done)), ct(std::move(ct)), left(chunks) {}
+
+            void run(std::size_t i, std::size_t first, std::size_t last) noexcept {
+               if(!failed.load(std::memory_order_relaxed))
+                  try {
+                     run_cancellable(ct, [&] { body(i, first, last); });
+                  }
+                  catch(...) {
+                     std::lock_guard<std::mutex> l{m};
+                     if(!error)
+                        error = std::current_exception();
+                     failed = true;
+                  }
+               if(left.fetch_sub(1, std::memory_order_acq_rel)==1)
+                  done(error);
+            }
+         };
+         const auto chunks = n==0? 1 : (n + chunk - 1) / chunk;
+         auto s = std::make_shared<state_t>(std::move(body), std::move(done), ct, chunks);
+         for(std::size_t i = 0; i+1<chunks; ++i)
+            ex.submit([s, i, chunk, n] { s->run(i, i*chunk, std::min(n, (i+1)*chunk)); });
+         s->run(chunks-1, (chunks-1)*chunk, n);
+      }
+
+      /**
+         node<R> which submits 'body(input_future, ct, promise)' to 'ex' when the input of 'af' is ready,
+         'body' fulfils the promise when its chunks are done
+      */
+      template <typename R, typename AF, typename Body>
+      auto chunked_node(AF af, executor& ex, Body body) {
+         return make_node([af = std::move(af), &ex, body = std::move(body)](const cancellation_token& ct) mutable {
+            auto p      = std::make_shared<promise<R>>();
+            auto result = p->get_future();
+            auto input  = launch_input(std::move(af), ct);
+            input.on_ready([input, ct, &ex, body = std::move(body), p]() mutable {
+               try {
+                  if(input.has_exception())
+                     input.get();
+                  ct.throw_if_stop_requested();
+               }
+               catch(...) {
+                  p->set_exception(std::current_exception());
+                  return;
+               }
+               const int node = input.numa_node();   // <-- the chunks are split next to the input
+               ex.submit([input = std::move(input), ct, body = std::move(body), p]() mutable {
+                  try {
+                     body(std::move(input), ct, p);
+                  }
+                  catch(...) {
+                     p->set_exception(std::current_exception());   // <-- e.g. std::bad_alloc before any chunk has started
+                  }
+               }, node);
+            });
+            return result;
+         });
+      }
+   }  // namespace detail
+
+   /**
+      \param f            U(const T&), applied to every element of the input vector<T>
+      \param chunk_bytes  size of a chunk
+      \return a callable object which takes a node (or any callable object which returns pdag::future<vector<T>>)
+              and returns node<vector<U>>
+   */
+   template <typename F>
+   auto parallel_map(F f, executor& ex = default_executor(), std::size_t chunk_bytes = detail::default_chunk_bytes) {
+      return [f, &ex, chunk_bytes](auto af) {
+         using input_type = typename decltype(detail::launch_input(af, {}))::value_type;
+         using T = typename input_type::value_type;
+         using U = std::decay_t<std::invoke_result_t<const F&, const T&>>;
+         static_assert(std::is_default_constructible_v<U>, "pdag::parallel_map: the result is written in place, it must be default constructible");
+         static_assert(!std::is_same_v<U, bool>, "pdag::parallel_map: std::vector<bool> cannot be written by several threads");
+         return detail::chunked_node<std::vector<U>>(std::move(af), ex, [f, &ex, chunk_bytes](future<input_type> input, cancellation_token ct, std::shared_ptr<promise<std::vector<U>>> p) {
+            const auto& in = input.get();
+            auto out = std::make_shared<std::vector<U>>(in.size());
+            detail::for_each_chunk(ex, in.size(), detail::chunk_items(chunk_bytes, std::max(sizeof(T), sizeof(U))), ct,
+               [f, &in, out, input](std::size_t, std::size_t first, std::size_t last) {
+                  for(auto i = first; i<last; ++i)
+                     (*out)[i] = f(in[i]);
+               },
+               [out, p](std::exception_ptr error) {
+                  if(error)
+                     p->set_exception(std::move(error));
+                  else
+                     p->set_value(std::move(*out));
+               });
+         });
+      };
+   }
+
+   /**
+      \param op    T(T,T), an associative operation
+      \param init  the initial value, the result of an empty input
+      \return a callable object which takes a node (or any callable object which returns pdag::future<vector<T>>)
+              and returns node<T>
+      A chunk is folded from its first element, not from 'init' (which need not be an identity of 'op'),
+      so the elements must be of type T: parallel_reduce(plus<>{}, 0., pool) for vector<double>, not 0.
+   */
+   template <typename Op, typename T>
+   auto parallel_reduce(Op op, T init, executor& ex = default_executor(), std::size_t chunk_bytes = detail::default_chunk_bytes) {
+      return [op, init, &ex, chunk_bytes](auto af) {
+         using input_type = typename decltype(detail::launch_input(af, {}))::value_type;
+         using E = typename input_type::value_type;
+         static_assert(std::is_same_v<E, T>, "pdag::parallel_reduce: the elements must be of the type of 'init', 'op' is T(T,T)");
+         return detail::chunked_node<T>(std::move(af), ex, [op, init, &ex, chunk_bytes](future<input_type> input, cancellation_token ct, std::shared_ptr<promise<T>> p) {
+            const auto& in   = input.get();
+            const auto chunk = detail::chunk_items(chunk_bytes, sizeof(E));
+            auto partials    = std::make_shared<std::vector<std::optional<T>>>(in.empty()? 1 : (in.size() + chunk - 1) / chunk);
+            detail::for_each_chunk(ex, in.size(), chunk, ct,
+               [op, &in, partials, input](std::size_t i, std::size_t first, std::size_t last) {
+                  if(first==last)
+                     return;
+                  T acc = in[first];
+                  for(auto j = first+1; j<last; ++j)
+                     acc = op(std::move(acc), in[j]);
+                  (*partials)[i] = std::move(acc);
+               },
+               [op, init, partials, p](std::exception_ptr error) {
+                  if(error) {
+                     p->set_exception(std::move(error));
+                     return;
+                  }
+                  try {
+                     T acc = init;
+                     for(auto& r : *partials)
+                        if(r)
+                           acc = op(std::move(acc), std::move(*r));
+                     p->set_value(std::move(acc));
+                  }
+                  catch(...) {
+                     p->set_exception(std::current_exception());
+                  }
+               });
+         });
+      };
+   }
+
+}  // namespace pdag
+
+#endif // _PDAG_ALGORITHM_H__
@@ -0,0 +1,319 @@
+/*
+   g++ benchmark.cpp -std=c++17 -O2 -Wextra -Wall -pedantic-errors -pthread -o benchmark
+
+   ./benchmark [--cost-us N] [--nodes N] [--threads 1,2,4,8] [--reps N] [--seed N] [--slots N]
+*/
+
+#include "graph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+/**
+   Synthetic DAG shapes for reproducible measurements of the scheduler:
+      chain    - n nodes one after another, no parallelism at all, pure per-node overhead
+      wide     - a source, n-2 independent nodes and a sink, embarrassingly parallel
+      diamond  - a chain of diamonds (fork into 'width' nodes, join), a barrier every other level
+      random   - random layered DAG, every node depends on 1..3 random nodes of the previous layers
+
+   Every node burns 'cost' of CPU time (it spins rather than sleeps, so workers really compete for cores).
+   A graph is executed
+      - serially on the calling thread in topological order (the baseline, no scheduling at all),
+      - by pdag::graph on pools of the given sizes.
+   Reported:
+      makespan   - best wall time of 'reps' runs,
+      speedup    - serial / makespan,
+      bound      - the best possible speedup: min(threads, work / critical path),
+      overhead   - (cores * makespan - work) / nodes, i.e. what the pool spends per node on top of the node itself,
+                   where cores = min(threads, hardware threads)
+
+   Before that the cost of a result slot alone is compared, pdag::promise/future against std::promise/future:
+      set + get  - a promise is created, fulfilled and read by the same thread,
+      pool node  - an empty job on a pool of one worker and a wait for its result, executor::async (std::future) vs pdag::launch,
+      chain      - a continuation on a ready result which runs inline, i.e. the pure cost of an edge of the DAG (pdag only).
+*/
+
+struct shape
+{
+   string                  name;
+   vector<vector<size_t>>  inputs;   // inputs[i] - predecessors of node 'i', always < i
+
+   size_t size() const noexcept {
+      return inputs.size();
+   }
+   size_t edges() const noexcept {
+      size_t e{0};
+      for(const auto& in : inputs)
+         e += in.size();
+      return e;
+   }
+   /**
+      number of nodes on the longest chain
+   */
+   size_t depth() const {
+      vector<size_t> d(size(), 1);
+      for(size_t i{0}; i<size(); ++i)
+         for(auto p : inputs[i])
+            d[i] = max(d[i], d[p]+1);
+      return size()? *max_element(begin(d), end(d)) : 0;
+   }
+};
+
+shape chain(size_t n)
+{
+   shape s{"chain", vector<vector<size_t>>(n)};
+   for(size_t i{1}; i<n; ++i)
+      s.inputs[i] = {i-1};
+   return s;
+}
+
+shape wide(size_t n)
+{
+   n = max<size_t>(n, 3);
+   shape s{"wide", vector<vector<size_t>>(n)};
+   for(size_t i{1}; i+1<n; ++i) {
+      s.inputs[i] = {0};
+      s.inputs[n-1].push_back(i);
+   }
+   return s;
+}
+
+shape diamond(size_t n, size_t width)
+{
+   shape s{"diamond", {{}}};
+   size_t join{0};
+   while(s.size()+width+1<=n) {
+      vector<size_t> fork;
+      for(size_t k{0}; k<width; ++k) {
+         fork.push_back(s.size());
+         s.inputs.push_back({join});
+      }
+      join = s.size();
+      s.inputs.push_back(fork);
+   }
+   return s;
+}
+
+shape random_layered(size_t n, size_t layers, mt19937_64& rnd)
+{
+   shape s{"random", vector<vector<size_t>>(n)};
+   const auto per_layer = max<size_t>(1, n / max<size_t>(1, layers));
+   for(size_t i{per_layer}; i<n; ++i) {
+      const auto layer_begin = i / per_layer * per_layer;
+      uniform_int_distribution<size_t> pick{0, layer_begin-1};
+      const auto k = uniform_int_distribution<size_t>{1, 3}(rnd);
+      for(size_t j{0}; j<k; ++j)
+         s.inputs[i].push_back(pick(rnd));
+      sort(begin(s.inputs[i]), end(s.inputs[i]));
+      s.inputs[i].erase(unique(begin(s.inputs[i]), end(s.inputs[i])), end(s.inputs[i]));
+   }
+   return s;
+}
+
+/**
+   Burns 'cost' of CPU time
+*/
+uint64_t spin(nanoseconds cost, uint64_t seed) noexcept
+{
+   const auto until = steady_clock::now() + cost;
+   uint64_t x{seed | 1};
+   do {
+      for(int i{0}; i<64; ++i)
+         x ^= x<<13, x ^= x>>7, x ^= x<<17;
+   } while(steady_clock::now()<until);
+   return x;
+}
+
+uint64_t node_work(const vector<uint64_t>& in, nanoseconds cost)
+{
+   uint64_t acc{1};
+   for(auto v : in)
+      acc += v;
+   return cost.count()>0? spin(cost, acc) : acc;
+}
+
+nanoseconds serial_run(const shape& s, nanoseconds cost)
+{
+   const auto start = steady_clock::now();
+   vector<uint64_t> results(s.size());
+   vector<uint64_t> in;
+   for(size_t i{0}; i<s.size(); ++i) {
+      in.clear();
+      for(auto p : s.inputs[i])
+         in.push_back(results[p]);
+      results[i] = node_work(in, cost);
+   }
+   return steady_clock::now()-start;
+}
+
+pdag::graph<uint64_t> build(const shape& s, nanoseconds cost)
+{
+   pdag::graph<uint64_t> g;
+   for(size_t i{0}; i<s.size(); ++i)
+      g.add([cost](const vector<uint64_t>& in) { return node_work(in, cost); }, 1. + cost.count());
+   for(size_t i{0}; i<s.size(); ++i)
+      for(auto p : s.inputs[i])
+         g.add_edge(p, i);
+   return g;
+}
+
+/**
+   \return average duration of op() in nanoseconds
+*/
+template <typename Op>
+double per_op(size_t n, Op op)
+{
+   const auto start = steady_clock::now();
+   for(size_t i{0}; i<n; ++i)
+      op(i);
+   return static_cast<double>(duration_cast<nanoseconds>(steady_clock::now()-start).count()) / max<size_t>(n, 1);
+}
+
+void slot_overhead(size_t n)
+{
+   uint64_t sink{0};
+   const auto std_set_get = per_op(n, [&](size_t i) {
+      promise<uint64_t> p;
+      auto f = p.get_future();
+      p.set_value(i);
+      sink += f.get();
+   });
+   const auto pdag_set_get = per_op(n, [&](size_t i) {
+      pdag::promise<uint64_t> p;
+      auto f = p.get_future();
+      p.set_value(i);
+      sink += f.get();
+   });
+
+   pdag::executor pool{1};
+   const auto std_node  = per_op(n/10, [&](size_t i) { sink += pool.async([i] { return i; }).get(); });
+   const auto pdag_node = per_op(n/10, [&](size_t i) { sink += pdag::launch(pool, [i] { return i; }).get(); });
+
+   pdag::promise<uint64_t> root;
+   auto last = root.get_future();
+   root.set_value(1);
+   const auto pdag_chain = per_op(n, [&](size_t) {
+      last = std::move(last).then(pool, [](pdag::future<uint64_t> f) { return f.get()+1; }, [] { return true; });
+   });
+   sink += last.get();
+
+   cout << "*** result slot, ns per operation (" << n << " iterations, checksum " << sink % 10 << ")\n"
+        << fixed << setprecision(1)
+        << left << setw(12) << "" << right << setw(14) << "std::future" << setw(14) << "pdag::future" << "\n"
+        << left << setw(12) << "set + get" << right << setw(14) << std_set_get << setw(14) << pdag_set_get << "\n"
+        << left << setw(12) << "pool node" << right << setw(14) << std_node << setw(14) << pdag_node << "\n"
+        << left << setw(12) << "chain" << right << setw(14) << "-" << setw(14) << pdag_chain << "\n\n";
+}
+
+struct options
+{
+   nanoseconds      cost{microseconds{10}};
+   size_t           nodes{2000};
+   vector<size_t>   threads;
+   int              reps{5};
+   uint64_t         seed{42};
+   size_t           slots{200'000};
+};
+
+options parse(int argc, char* argv[])
+{
+   options o;
+   for(int i{1}; i<argc; ++i) {
+      const string arg{argv[i]};
+      if(i+1>=argc)
+         throw invalid_argument{"missing value of " + arg};
+      const string value{argv[++i]};
+      if(arg=="--cost-us")
+         o.cost = duration_cast<nanoseconds>(duration<double, micro>{stod(value)});
+      else if(arg=="--nodes")
+         o.nodes = stoul(value);
+      else if(arg=="--reps")
+         o.reps = max(1, stoi(value));
+      else if(arg=="--seed")
+         o.seed = stoull(value);
+      else if(arg=="--slots")
+         o.slots = stoul(value);
+      else if(arg=="--threads") {
+         istringstream list{value};
+         for(string t; getline(list, t, ',');)
+            o.threads.push_back(max<size_t>(1, stoul(t)));
+      }
+      else
+         throw invalid_argument{"unknown option " + arg};
+   }
+   if(o.threads.empty())
+      for(size_t t{1}; t<=max<size_t>(1, thread::hardware_concurrency()); t *= 2)
+         o.threads.push_back(t);
+   return o;
+}
+
+double ms(nanoseconds d)
+{
+   return duration<double, milli>(d).count();
+}
+
+int main(int argc, char* argv[])
+{
+   try {
+      const auto o = parse(argc, argv);
+      slot_overhead(o.slots);
+
+      mt19937_64 rnd{o.seed};
+      const vector<shape> shapes{
+         chain(o.nodes),
+         wide(o.nodes),
+         diamond(o.nodes, 8),
+         random_layered(o.nodes, 20, rnd)
+      };
+
+      cout << "*** node cost " << duration<double, micro>(o.cost).count() << " us, best of " << o.reps << " runs"
+           << ", " << thread::hardware_concurrency() << " hardware threads\n"
+           << fixed << setprecision(2)
+           << left << setw(9) << "shape" << right << setw(7) << "nodes" << setw(7) << "edges" << setw(7) << "depth"
+           << setw(9) << "threads" << setw(12) << "serial ms" << setw(13) << "makespan ms"
+           << setw(9) << "speedup" << setw(8) << "bound" << setw(15) << "overhead us/n" << "\n";
+
+      for(const auto& s : shapes) {
+         auto serial = nanoseconds::max();
+         for(int r{0}; r<o.reps; ++r)
+            serial = min(serial, serial_run(s, o.cost));
+         const auto work = o.cost * static_cast<nanoseconds::rep>(s.size());
+         const auto g = build(s, o.cost);
+
+         for(auto t : o.threads) {
+            pdag::executor pool{t};
+            auto makespan = nanoseconds::max();
+            for(int r{0}; r<o.reps; ++r) {
+               const auto start = steady_clock::now();
+               g.run(pool).get();
+               makespan = min(makespan, duration_cast<nanoseconds>(steady_clock::now()-start));
+            }
+            const auto bound    = o.cost.count()>0? min<double>(t, static_cast<double>(s.size()) / s.depth()) : 1.;
+            const auto cores    = min<size_t>(t, max(1u, thread::hardware_concurrency()));
+            const auto overhead = (static_cast<double>(cores) * makespan.count() - work.count()) / s.size() / 1000.;
+            cout << left << setw(9) << s.name << right << setw(7) << s.size() << setw(7) << s.edges() << setw(7) << s.depth()
+                 << setw(9) << t << setw(12) << ms(serial) << setw(13) << ms(makespan)
+                 << setw(9) << static_cast<double>(serial.count()) / makespan.count() << setw(8) << bound
+                 << setw(15) << overhead << "\n";
+         }
+      }
+   }
+   catch(const exception& e) {
+      cerr << "*** error: " << e.what() << "\n";
+      return EXIT_FAILURE;
+   }
+}
@@ -0,0 +1,167 @@
+#if !defined(_PDAG_CANCELLATION_H__)
+#define _PDAG_CANCELLATION_H__
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <utility>
+
+/**
+   Cooperative cancellation of a DAG run.
+   A cancellation_token is passed to the root node, e.g. res(token), and flows to every upstream node.
+      - a node which has not been started yet is skipped (its future holds operation_cancelled) if the token is cancelled
+        or its deadline has passed;
+      - a node which is running can poll this_node::stop_requested();
+      - a node which throws cancels the token, so the other branches release CPU right away instead of running to completion.
+
+   Usage Example:
+      cancellation_source cs;
+      cs.cancel_after(2s);
+      auto result = res(cs.token());
+      ...
+      cs.cancel();   // from any thread
+
+   \see std::stop_token, https://en.cppreference.com/w/cpp/thread/stop_token
+*/
+
+namespace pdag
+{
+   class operation_cancelled : public std::exception {
+   public:
+      const char* what() const noexcept override {
+         return "pdag: operation cancelled";
+      }
+   };
+
+   namespace detail
+   {
+      struct cancellation_state {
+         using clock = std::chrono::steady_clock;
+         using rep_t = clock::duration::rep;
+
+         std::atomic<bool>    cancelled{false};
+         std::atomic<rep_t>   deadline{clock::time_point::max().time_since_epoch().count()};
+
+         bool stop_requested() const noexcept {
+            if(cancelled.load(std::memory_order_relaxed))
+               return true;
+            const auto d = deadline.load(std::memory_order_relaxed);
+            return d!=clock::time_point::max().time_since_epoch().count()
+                && clock::now().time_since_epoch().count()>=d;
+         }
+      };
+   }  // namespace detail
+
+   /**
+      A cheap copyable view of a cancellation state. A default constructed token is never cancelled.
+   */
+   class cancellation_token {
+      std::shared_ptr<detail::cancellation_state> s_;
+
+      friend class cancellation_source;
+      explicit cancellation_token(std::shared_ptr<detail::cancellation_state> s) noexcept : s_(std::move(s)) {}
+
+   public:
+      cancellation_token() noexcept = default;
+
+      bool stop_possible() const noexcept {
+         return static_cast<bool>(s_);
+      }
+      bool stop_requested() const noexcept {
+         return s_ && s_->stop_requested();
+      }
+      void throw_if_stop_requested() const {
+         if(stop_requested())
+            throw operation_cancelled{};
+      }
+
+      /**
+         Any holder of the token may cancel the whole run, e.g. a node which has failed
+      */
+      void cancel() const noexcept {
+         if(s_)
+            s_->cancelled = true;
+      }
+   };
+
+   class cancellation_source {
+      std::shared_ptr<detail::cancellation_state> s_{std::make_shared<detail::cancellation_state>()};
+
+   public:
+      cancellation_token token() const noexcept {
+         return cancellation_token{s_};
+      }
+      void cancel() const noexcept {
+         s_->cancelled = true;
+      }
+      void cancel_at(std::chrono::steady_clock::time_point deadline) const noexcept {
+         s_->deadline = deadline.time_since_epoch().count();
+      }
+      template <typename Rep, typename Period>
+      void cancel_after(std::chrono::duration<Rep, Period> d) const noexcept {
+         cancel_at(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(d));
+      }
+      bool stop_requested() const noexcept {
+         return s_->stop_requested();
+      }
+   };
+
+   namespace this_node
+   {
+      namespace detail
+      {
+         inline thread_local const cancellation_token* current{nullptr};
+      }
+
+      /**
+         \return the token of the node which is being executed by the calling thread
+      */
+      inline cancellation_token token() {
+         return detail::current? *detail::current : cancellation_token{};
+      }
+
+      /**
+         Polled by a long running node to find out whether its result is still needed
+      */
+      inline bool stop_requested() noexcept {
+         return detail::current && detail::current->stop_requested();
+      }
+
+      inline void throw_if_stop_requested() {
+         if(stop_requested())
+            throw operation_cancelled{};
+      }
+   }  // namespace this_node
+
+   namespace detail
+   {
+      /**
+         Runs 'f' on behalf of a node launched with 'ct':
+         it is skipped if the run has been cancelled, 'ct' is visible via this_node:: while 'f' is running,
+         if 'f' fails the whole run is cancelled.
+      */
+      template <typename F>
+      decltype(auto) run_cancellable(const cancellation_token& ct, F&& f) {
+         ct.throw_if_stop_requested();
+         struct scope_t {
+            const cancellation_token* prev{this_node::detail::current};
+            explicit scope_t(const cancellation_token& ct) noexcept { this_node::detail::current = &ct; }
+            ~scope_t() { this_node::detail::current = prev; }
+         } scope{ct};
+         try {
+            return std::forward<F>(f)();
+         }
+         catch(const operation_cancelled&) {
+            throw;
+         }
+         catch(...) {
+            ct.cancel();
+            throw;
+         }
+      }
+   }  // namespace detail
+
+}  // namespace pdag
+
+#endif // _PDAG_CANCELLATION_H__
@@ -0,0 +1,508 @@
+#if !defined(_PDAG_EXECUTOR_H__)
+#define _PDAG_EXECUTOR_H__
+
+#include "topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pdag
+{
+   namespace detail
+   {
+      /**
+         Per-thread free lists of blocks of 'Size' bytes for jobs, result slots and their continuations.
+         A block may be released by any thread, it joins the free list of the releasing thread then.
+      */
+      template <std::size_t Size>
+      class block_pool {
+         struct free_block {
+            free_block* next;
+         };
+         struct drain_t {
+            ~drain_t() {
+               while(head_)
+                  ::operator delete(std::exchange(head_, head_->next));
+               closed_ = true;
+            }
+         };
+
+         static constexpr std::size_t max_cached = 1024;
+
+         inline static thread_local free_block*   head_{nullptr};
+         inline static thread_local std::size_t   count_{0};
+         inline static thread_local bool          closed_{false};   // <-- the thread is exiting, its list is gone
+
+      public:
+         static void* allocate() {
+            if(head_) {
+               --count_;
+               return std::exchange(head_, head_->next);
+            }
+            return ::operator new(Size);
+         }
+         static void deallocate(void* p) noexcept {
+            if(closed_ || count_>=max_cached) {
+               ::operator delete(p);
+               return;
+            }
+            thread_local drain_t drain;   // <-- the list of this thread is released when the thread exits
+            (void)drain;
+            head_ = ::new(p) free_block{head_};
+            ++count_;
+         }
+      };
+
+      /**
+         An allocator of single objects from block_pool, anything else (arrays, big or over-aligned types) goes to std::allocator
+      */
+      template <typename U>
+      struct pool_allocator {
+         using value_type = U;
+
+         static constexpr std::size_t block  = (sizeof(U) + 63) / 64 * 64;
+         static constexpr bool        pooled = block<=1024 && alignof(U)<=alignof(std::max_align_t);
+
+         pool_allocator() noexcept = default;
+         template <typename V>
+         pool_allocator(const pool_allocator<V>&) noexcept {}
+
+         U* allocate(std::size_t n) {
+            if(pooled && n==1)
+               return static_cast<U*>(block_pool<block>::allocate());
+            return std::allocator<U>{}.allocate(n);
+         }
+         void deallocate(U* p, std::size_t n) noexcept {
+            if(pooled && n==1)
+               block_pool<block>::deallocate(p);
+            else
+               std::allocator<U>{}.deallocate(p, n);
+         }
+
+         template <typename V>
+         bool operator==(const pool_allocator<V>&) const noexcept {
+            return true;
+         }
+         template <typename V>
+         bool operator!=(const pool_allocator<V>&) const noexcept {
+            return false;
+         }
+      };
+
+      /**
+         A move-only analog of std::function<R(Args...)>.
+         std::function requires the target to be CopyConstructible,
+         that rules out std::packaged_task, std::promise, std::unique_ptr and friends.
+         A small target (a few captured pointers) is stored inline, so a typical job costs no allocation,
+         a bigger one is allocated from block_pool.
+      */
+
+      template <typename Signature>
+      class unique_function;
+
+      template <typename R, typename... Args>
+      class unique_function<R(Args...)> {
+         struct concept_t {
+            virtual ~concept_t() = default;
+            virtual R call(Args...) = 0;
+            virtual concept_t* move_to(void* buffer) noexcept = 0;   // for an inline target only
+            virtual void destroy() noexcept = 0;                      // for a pooled target only
+         };
+
+         template <typename F>
+         struct model_t : concept_t {
+            F f_;
+            explicit model_t(F&& f) : f_(std::move(f)) {}
+            explicit model_t(const F& f) : f_(f) {}
+            R call(Args... args) override {
+               return f_(std::forward<Args>(args)...);
+            }
+            concept_t* move_to(void* buffer) noexcept override {
+               return ::new(buffer) model_t{std::move(f_)};
+            }
+            void destroy() noexcept override {
+               this->~model_t();
+               pool_allocator<model_t>{}.deallocate(this, 1);
+            }
+         };
+
+         static constexpr std::size_t buffer_size = 4*sizeof(void*);
+
+         template <typename F>
+         static constexpr bool fits_inline =
+            sizeof(model_t<F>)<=buffer_size && alignof(model_t<F>)<=alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+         alignas(std::max_align_t) unsigned char   buffer_[buffer_size];
+         concept_t*                                impl_{nullptr};
+         bool                                      inline_{false};
+
+         void reset() noexcept {
+            if(inline_)
+               impl_->~concept_t();
+            else if(impl_)
+               impl_->destroy();
+            impl_   = nullptr;
+            inline_ = false;
+         }
+
+         void take(unique_function& other) noexcept {
+            inline_ = other.inline_;
+            if(inline_) {
+               impl_ = other.impl_->move_to(buffer_);
+               other.reset();
+            }
+            else
+               impl_ = std::exchange(other.impl_, nullptr);
+         }
+
+      public:
+         unique_function() noexcept = default;
+
+         template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, unique_function>>>
+         unique_function(F&& f) {
+            using model = model_t<std::decay_t<F>>;
+            if constexpr(fits_inline<std::decay_t<F>>) {
+               impl_   = ::new(static_cast<void*>(buffer_)) model{std::forward<F>(f)};
+               inline_ = true;
+            }
+            else {
+               pool_allocator<model> a;
+               auto* p = a.allocate(1);
+               try {
+                  impl_ = ::new(static_cast<void*>(p)) model{std::forward<F>(f)};
+               }
+               catch(...) {
+                  a.deallocate(p, 1);
+                  throw;
+               }
+            }
+         }
+
+         unique_function(unique_function&& other) noexcept {
+            take(other);
+         }
+         unique_function& operator=(unique_function&& other) noexcept {
+            if(this!=&other) {
+               reset();
+               take(other);
+            }
+            return *this;
+         }
+         ~unique_function() {
+            reset();
+         }
+
+         explicit operator bool() const noexcept {
+            return impl_!=nullptr;
+         }
+         R operator()(Args... args) {
+            return impl_->call(std::forward<Args>(args)...);
+         }
+      };
+
+      using job = unique_function<void()>;
+
+      /**
+         Per-worker double-ended queue.
+         The owner pushes and pops at the back (LIFO keeps the most recently produced, cache-warm data on the same core),
+         thieves take from the front (FIFO, the oldest work items tend to be the largest ones).
+         \see C++ Concurrency in Action by Anthony Williams, Ch 9.1.5 "Work stealing"
+      */
+
+      class work_stealing_queue {
+         std::deque<job>      q_;
+         mutable std::mutex   m_;
+      public:
+         void push(job j) {
+            std::lock_guard<std::mutex> l{m_};
+            q_.push_back(std::move(j));
+         }
+         bool try_pop(job& j) {
+            std::lock_guard<std::mutex> l{m_};
+            if(q_.empty())
+               return false;
+            j = std::move(q_.back());
+            q_.pop_back();
+            return true;
+         }
+         bool try_steal(job& j) {
+            std::lock_guard<std::mutex> l{m_};
+            if(q_.empty())
+               return false;
+            j = std::move(q_.front());
+            q_.pop_front();
+            return true;
+         }
+      };
+   }  // namespace detail
+
+   /**
+      A fixed pool of worker threads (one per core by default) with work-stealing deques.
+      The number of OS threads does not depend on the number of submitted tasks.
+
+      Usage Example:
+         executor pool{4};
+         std::future<int> r = pool.async([](int a, int b) { return a+b; }, 1, 2);
+         pool.submit([]{ ... });  // fire and forget
+
+      Workers may be pinned to cores of a cpu_topology (see topology.h), they are spread evenly over NUMA nodes then:
+         executor pool{16, cpu_topology::detect()};
+         pool.submit([]{ ... }, 1);  // preferably on a worker of NUMA node 1
+      An idle worker steals from workers of its own node first and from the other nodes only if there is nothing local.
+      If pinning is not supported or it fails, workers run unpinned and NUMA hints are ignored.
+   */
+
+   class executor {
+      using queue_ptr = std::unique_ptr<detail::work_stealing_queue>;
+
+      std::vector<queue_ptr>     queues_;
+      std::vector<std::thread>   threads_;
+      std::atomic<bool>          done_{false};
+      std::atomic<std::size_t>   pending_{0};   // jobs pushed but not taken yet
+      std::atomic<std::size_t>   sleepers_{0};
+      std::atomic<std::size_t>   next_{0};      // round-robin for submissions from outside of the pool
+      std::mutex                 m_;
+      std::condition_variable    cv_;
+      std::chrono::nanoseconds   spawn_overhead_{0};
+      std::vector<int>           worker_node_;  // NUMA node of every worker, -1 if it is not pinned
+      std::atomic<std::size_t>   started_{0};
+
+      inline static thread_local executor*   current_{nullptr};
+      inline static thread_local std::size_t index_{0};
+      inline static thread_local int         numa_node_{-1};
+
+      bool try_take(detail::job& j) {
+         const auto n = queues_.size();
+         if(current_==this && queues_[index_]->try_pop(j))
+            return true;
+         const auto start = current_==this? index_+1 : next_.load(std::memory_order_relaxed);
+         const auto home  = current_==this? worker_node_[index_] : -1;
+         for(int pass = home<0? 1 : 0; pass<2; ++pass)   // <-- the own NUMA node first
+            for(std::size_t i{0}; i<n; ++i) {
+               const auto q = (start+i)%n;
+               if((pass>0 || worker_node_[q]==home) && queues_[q]->try_steal(j))
+                  return true;
+            }
+         return false;
+      }
+
+      void push(std::size_t i, detail::job j) {
+         ++pending_;   // <-- before the job is visible, so a thief never takes it from a count of 0
+         try {
+            queues_[i]->push(std::move(j));
+         }
+         catch(...) {
+            --pending_;
+            throw;
+         }
+         if(sleepers_>0) {
+            std::lock_guard<std::mutex> l{m_};
+            cv_.notify_one();
+         }
+      }
+
+      void worker_loop(std::size_t index, int cpu, int node) {
+         if(cpu>=0 && !cpu_topology::pin_current_thread(static_cast<unsigned>(cpu)))
+            node = -1;
+         worker_node_[index] = node;
+         current_   = this;
+         index_     = index;
+         numa_node_ = node;
+         started_.fetch_add(1, std::memory_order_acq_rel);
+         while(started_.load(std::memory_order_acquire)<worker_node_.size())   // <-- until worker_node_ is complete
+            std::this_thread::yield();
+         for(;;) {
+            detail::job j;
+            if(try_take(j)) {
+               --pending_;
+               j();
+               continue;
+            }
+            std::unique_lock<std::mutex> l{m_};
+            ++sleepers_;
+            cv_.wait(l, [this]{ return pending_>0 || done_; });
+            --sleepers_;
+            if(done_ && pending_==0)
+               return;
+         }
+      }
+
+      /**
+         Average round trip of an empty job: submit, wake up of an idle worker, execution
+      */
+      std::chrono::nanoseconds measure_spawn_overhead() {
+         constexpr int samples{64};
+         std::atomic<bool> done{false};
+         const auto start = std::chrono::steady_clock::now();
+         for(int i{0}; i<samples; ++i) {
+            done = false;
+            submit([&done] { done = true; });
+            while(!done)
+               std::this_thread::yield();
+         }
+         return (std::chrono::steady_clock::now()-start) / samples;
+      }
+
+      /**
+         \param placement  {cpu, NUMA node} of every worker, {-1,-1} for an unpinned one
+      */
+      void start(const std::vector<std::pair<int, int>>& placement) {
+         worker_node_.assign(placement.size(), -1);
+         for(std::size_t i{0}; i<placement.size(); ++i)
+            queues_.push_back(std::make_unique<detail::work_stealing_queue>());
+         for(std::size_t i{0}; i<placement.size(); ++i)
+            threads_.emplace_back(&executor::worker_loop, this, i, placement[i].first, placement[i].second);
+         while(started_.load(std::memory_order_acquire)<placement.size())   // <-- worker_node_ is read-only from now on
+            std::this_thread::yield();
+         spawn_overhead_ = measure_spawn_overhead();
+      }
+
+   public:
+      explicit executor(std::size_t threads = std::thread::hardware_concurrency()) {
+         start(std::vector<std::pair<int, int>>(std::max<std::size_t>(threads, 1), {-1, -1}));
+      }
+
+      /**
+         Pins the workers to CPUs of 'topology': the i-th NUMA node gets a contiguous block of about threads/nodes() workers,
+         workers of a node go round-robin over its CPUs
+      */
+      executor(std::size_t threads, const cpu_topology& topology) {
+         threads = std::max<std::size_t>(threads, 1);
+         std::vector<std::pair<int, int>> placement;
+         for(std::size_t i{0}; i<threads; ++i) {
+            const auto node = i * topology.nodes() / threads;
+            const auto rank = i - (node * threads + topology.nodes() - 1) / topology.nodes();   // <-- index of the worker within its node
+            const auto& cpus = topology.cpus(node);
+            placement.emplace_back(static_cast<int>(cpus[rank % cpus.size()]), topology.node_id(node));
+         }
+         start(placement);
+      }
+
+      ~executor() {
+         {
+            std::lock_guard<std::mutex> l{m_};
+            done_ = true;
+         }
+         cv_.notify_all();
+         for(auto& t : threads_)
+            t.join();
+      }
+
+      executor(const executor&) = delete;
+      executor& operator=(const executor&) = delete;
+
+      std::size_t size() const noexcept {
+         return threads_.size();
+      }
+
+      /**
+         \return the cost of handing a job over to the pool measured once at construction,
+                 a job cheaper than that is better to be executed inline
+      */
+      std::chrono::nanoseconds spawn_overhead() const noexcept {
+         return spawn_overhead_;
+      }
+
+      /**
+         \return the executor which owns the calling thread, nullptr if the calling thread is not a worker of any pool
+      */
+      static executor* current() noexcept {
+         return current_;
+      }
+
+      /**
+         \return index of the calling worker in [0,size()) of its pool
+      */
+      static std::size_t current_index() noexcept {
+         return index_;
+      }
+
+      /**
+         \return the NUMA node the calling worker is pinned to, -1 if it is unknown (not a worker, not pinned)
+      */
+      static int current_numa_node() noexcept {
+         return numa_node_;
+      }
+
+      /**
+         Enqueues 'f' for execution on one of the workers.
+         A worker submits into its own deque, any other thread distributes jobs round-robin.
+      */
+      template <typename F>
+      void submit(F&& f) {
+         push(current_==this? index_ : next_++ % queues_.size(), detail::job{std::forward<F>(f)});
+      }
+
+      /**
+         The same as submit(f) but 'f' is enqueued to a worker of 'numa_node' (round-robin) unless the calling worker is on it.
+         No worker on 'numa_node' (or -1) means no preference.
+      */
+      template <typename F>
+      void submit(F&& f, int numa_node) {
+         if(numa_node>=0 && !(current_==this && worker_node_[index_]==numa_node)) {
+            const auto n     = queues_.size();
+            const auto start = next_++;
+            for(std::size_t i{0}; i<n; ++i)
+               if(worker_node_[(start+i)%n]==numa_node) {
+                  push((start+i)%n, detail::job{std::forward<F>(f)});
+                  return;
+               }
+         }
+         submit(std::forward<F>(f));
+      }
+
+      /**
+         The same as std::async(std::launch::async, f, args...) but on a bounded pool of threads.
+      */
+      template <typename F, typename... Args>
+      auto async(F&& f, Args&&... args) {
+         using result_type = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+         std::packaged_task<result_type()> task{
+            [f = std::forward<F>(f), prms = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+               return std::apply(std::move(f), std::move(prms));
+            }
+         };
+         auto result = task.get_future();
+         submit(std::move(task));
+         return result;
+      }
+
+      /**
+         Runs one queued job on the calling thread if there is any.
+         Useful for a thread that has to wait for something: instead of blocking it helps the pool.
+         \return false if there was nothing to run
+      */
+      bool run_pending_task() {
+         detail::job j;
+         if(!try_take(j))
+            return false;
+         --pending_;
+         j();
+         return true;
+      }
+   };
+
+   /**
+      Process-wide pool used whenever an executor is not specified explicitly
+   */
+   inline executor& default_executor() {
+      static executor ex;
+      return ex;
+   }
+
+}  // namespace pdag
+
+#endif // _PDAG_EXECUTOR_H__
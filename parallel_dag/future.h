@@ -0,0 +1,500 @@
+#if !defined(_PDAG_FUTURE_H__)
+#define _PDAG_FUTURE_H__
+
+#include "executor.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+   std::future has no way to say "run this when the value is ready" without parking a thread in .get().
+   pdag::future<T> is a shared (copyable, like std::shared_future) handle that supports continuations:
+      future<T>::then(ex, f)  - f(future<T>) is submitted to 'ex' as soon as the value (or an exception) is published
+      when_all(f1, f2, ...)   - future<tuple<future<T1>,future<T2>,...>> which becomes ready when all inputs are ready
+   No thread ever blocks waiting for upstream results, only an external consumer may call get().
+
+   \see https://en.cppreference.com/w/cpp/experimental/future/then
+   \see https://en.cppreference.com/w/cpp/experimental/when_all
+*/
+
+namespace pdag
+{
+   template <typename T> class future;
+   template <typename T> class promise;
+
+   namespace detail
+   {
+      template <typename T>
+      using storage_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+      /**
+         A one-shot result slot: the value, the exception and the continuation list live in one pooled allocation
+         (together with the reference counter of std::allocate_shared).
+         Continuations are a lock-free stack which the publisher swaps for the 'ready' mark, so publishing is wait-free
+         and neither readers nor writers take a lock. Only a thread that has to block in wait() sleeps on a condition variable of its own.
+      */
+      template <typename T>
+      class shared_state {
+         struct continuation {
+            job            j;
+            continuation*  next;
+         };
+
+         std::atomic<continuation*>    head_{nullptr};   // pending continuations, ready_mark() once the result is published
+         std::atomic<bool>             satisfied_{false};
+         std::optional<storage_t<T>>   value_;
+         std::exception_ptr            error_;
+         std::atomic<std::size_t>      handles_{0};   // number of pdag::future<T> objects which refer to this state
+         int                           numa_node_{-1};   // where the result has been published, see executor::current_numa_node
+
+         static continuation* ready_mark() noexcept {
+            static char tag;
+            return reinterpret_cast<continuation*>(&tag);
+         }
+
+         static continuation* create(job j, continuation* next) {
+            pool_allocator<continuation> a;
+            return ::new(static_cast<void*>(a.allocate(1))) continuation{std::move(j), next};
+         }
+         static void destroy(continuation* c) noexcept {
+            c->~continuation();
+            pool_allocator<continuation>{}.deallocate(c, 1);
+         }
+
+         template <typename Setter>
+         void publish(Setter&& set) {
+            if(satisfied_.exchange(true, std::memory_order_relaxed))
+               throw std::future_error{std::future_errc::promise_already_satisfied};
+            try {
+               set();
+            }
+            catch(...) {
+               satisfied_ = false;   // <-- e.g. a throwing copy of the value, the promise may still store an exception
+               throw;
+            }
+            numa_node_ = executor::current_numa_node();
+            auto* c = head_.exchange(ready_mark(), std::memory_order_acq_rel);
+            continuation* fifo{nullptr};   // <-- the stack is reversed, continuations run in the order they were attached
+            while(c) {
+               auto* next = c->next;
+               c->next = fifo;
+               fifo    = std::exchange(c, next);
+            }
+            while(fifo) {
+               auto* next = fifo->next;
+               fifo->j();
+               destroy(fifo);
+               fifo = next;
+            }
+         }
+
+      public:
+         shared_state() = default;
+         shared_state(const shared_state&) = delete;
+         shared_state& operator=(const shared_state&) = delete;
+         ~shared_state() {
+            for(auto* c = head_.load(std::memory_order_acquire); c && c!=ready_mark();)
+               destroy(std::exchange(c, c->next));
+         }
+
+         template <typename... Args>
+         void set_value(Args&&... args) {
+            publish([&]{ value_.emplace(std::forward<Args>(args)...); });
+         }
+         void set_exception(std::exception_ptr e) {
+            publish([&]{ error_ = std::move(e); });
+         }
+
+         bool is_ready() const noexcept {
+            return head_.load(std::memory_order_acquire)==ready_mark();
+         }
+         bool has_exception() const noexcept {
+            return is_ready() && error_;
+         }
+         int numa_node() const noexcept {
+            return is_ready()? numa_node_ : -1;
+         }
+
+         /**
+            's' is executed right away by the calling thread if the state is ready, otherwise by the thread which publishes the result
+         */
+         void on_ready(job s) {
+            auto* head = head_.load(std::memory_order_acquire);
+            if(head!=ready_mark()) {
+               auto* c = create(std::move(s), head);
+               while(!head_.compare_exchange_weak(c->next, c, std::memory_order_release, std::memory_order_acquire))
+                  if(c->next==ready_mark()) {
+                     s = std::move(c->j);
+                     destroy(c);
+                     s();
+                     return;
+                  }
+               return;
+            }
+            s();
+         }
+
+         /**
+            A worker of a pool keeps running other pending jobs while it is waiting,
+            so a bounded pool cannot deadlock by all of its threads waiting for jobs that are still queued.
+         */
+         void wait() {
+            using namespace std::chrono_literals;
+            for(int i{0}; i<64; ++i) {   // <-- a short job is often done before a sleeper is worth setting up
+               if(is_ready())
+                  return;
+               std::this_thread::yield();
+            }
+            struct sleeper_t {
+               std::mutex                 m;
+               std::condition_variable    cv;
+               bool                       done{false};
+            } w;
+            on_ready([&w] {
+               std::lock_guard<std::mutex> l{w.m};
+               w.done = true;
+               w.cv.notify_all();
+            });
+            std::unique_lock<std::mutex> l{w.m};
+            if(auto* ex = executor::current()) {
+               while(!w.done) {
+                  l.unlock();
+                  const bool ran = ex->run_pending_task();
+                  l.lock();
+                  if(!ran)
+                     w.cv.wait_for(l, 100us, [&w]{ return w.done; });
+               }
+               return;
+            }
+            w.cv.wait(l, [&w]{ return w.done; });   // <-- 'w' is released only after the publisher has left it
+         }
+
+         std::conditional_t<std::is_void_v<T>, void, const storage_t<T>&> get() {
+            wait();
+            if(error_)
+               std::rethrow_exception(error_);
+            if constexpr(!std::is_void_v<T>)
+               return *value_;
+         }
+
+         void attach() noexcept {
+            handles_.fetch_add(1, std::memory_order_relaxed);
+         }
+         void detach() noexcept {
+            handles_.fetch_sub(1, std::memory_order_release);
+         }
+
+         /**
+            The value is moved out if the calling handle is the only one, otherwise it is copied.
+            The acquire load pairs with detach() of the other handles, so their reads of the value happen before the move.
+         */
+         std::conditional_t<std::is_void_v<T>, void, storage_t<T>> take() {
+            get();
+            if constexpr(!std::is_void_v<T>) {
+               if(handles_.load(std::memory_order_acquire)==1)
+                  return std::move(*value_);
+               if constexpr(std::is_copy_constructible_v<T>)
+                  return *value_;
+               else
+                  throw std::logic_error{"pdag: a move-only result is shared by several consumers"};
+            }
+         }
+      };
+
+      /**
+         Stores f(args...) into 'p', a result or an exception
+      */
+      template <typename T, typename F, typename... Args>
+      void fulfil(promise<T>& p, F&& f, Args&&... args) noexcept {
+         try {
+            if constexpr(std::is_void_v<T>) {
+               std::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+               p.set_value();
+            }
+            else
+               p.set_value(std::invoke(std::forward<F>(f), std::forward<Args>(args)...));
+         }
+         catch(...) {
+            p.set_exception(std::current_exception());
+         }
+      }
+
+      /**
+         An inline continuation runs on the stack of the thread which publishes its input: publish -> continuation -> set_value -> publish ...
+         Beyond max_inline_depth nested levels a continuation is submitted to the executor even if it asks to run inline,
+         so a long chain of cheap nodes unwinds through the pool instead of overflowing the stack.
+      */
+      inline constexpr std::size_t max_inline_depth{64};
+
+      class inline_scope {
+         inline static thread_local std::size_t depth_{0};
+      public:
+         inline_scope() noexcept { ++depth_; }
+         ~inline_scope() { --depth_; }
+         inline_scope(const inline_scope&) = delete;
+         inline_scope& operator=(const inline_scope&) = delete;
+
+         static bool available() noexcept {
+            return depth_ < max_inline_depth;
+         }
+      };
+   }  // namespace detail
+
+   template <typename T>
+   class future {
+      std::shared_ptr<detail::shared_state<T>> s_;
+
+      friend class promise<T>;
+      explicit future(std::shared_ptr<detail::shared_state<T>> s) noexcept : s_(std::move(s)) {
+         if(s_)
+            s_->attach();
+      }
+
+      static int anywhere(const future&) noexcept {
+         return -1;
+      }
+
+      template <typename F, typename P, typename N>
+      static auto continue_with(future self, executor& ex, F f, P run_inline, N place) {
+         using result_type = std::invoke_result_t<F, future<T>>;
+         promise<result_type> p;
+         auto result = p.get_future();
+         auto* s = self.s_.get();
+         s->on_ready([&ex, self = std::move(self), f = std::move(f), p = std::move(p), run_inline = std::move(run_inline), place = std::move(place)]() mutable {
+            if(detail::inline_scope::available() && run_inline()) {
+               detail::inline_scope scope;
+               detail::fulfil(p, std::move(f), std::move(self));
+               return;
+            }
+            const int node = place(std::as_const(self));
+            ex.submit([self = std::move(self), f = std::move(f), p = std::move(p)]() mutable {
+               detail::fulfil(p, std::move(f), std::move(self));
+            }, node);
+         });
+         return result;
+      }
+
+   public:
+      using value_type = T;
+
+      future() noexcept = default;
+      future(const future& other) noexcept : future(other.s_) {}
+      future(future&& other) noexcept = default;
+      future& operator=(const future& other) noexcept {
+         future{other}.swap(*this);
+         return *this;
+      }
+      future& operator=(future&& other) noexcept {
+         future{std::move(other)}.swap(*this);
+         return *this;
+      }
+      ~future() {
+         if(s_)
+            s_->detach();
+      }
+
+      void swap(future& other) noexcept {
+         std::swap(s_, other.s_);
+      }
+
+      bool valid() const noexcept {
+         return static_cast<bool>(s_);
+      }
+      bool is_ready() const {
+         return s_->is_ready();
+      }
+      /**
+         \return true if the future is ready and holds an exception
+      */
+      bool has_exception() const {
+         return s_->has_exception();
+      }
+      /**
+         \return the NUMA node of the worker which has published the result, -1 if it is unknown (see executor::current_numa_node)
+      */
+      int numa_node() const {
+         return s_->numa_node();
+      }
+      void wait() const {
+         s_->wait();
+      }
+
+      /**
+         Blocks until the result is ready. Within a DAG node prefer then(...) instead.
+         \return the value or rethrows the stored exception
+      */
+      decltype(auto) get() const {
+         return s_->get();
+      }
+
+      /**
+         The same as get() but it returns the value itself, the handle is released.
+         The value is moved out if this is the only handle of the result (e.g. the single consumer of a node),
+         otherwise it is copied, std::logic_error for a move-only type which is shared.
+      */
+      decltype(auto) consume() {
+         const future self{std::move(*this)};
+         return self.s_->take();
+      }
+
+      /**
+         \return a future for f(*this) which is submitted to 'ex' when this future becomes ready
+      */
+      template <typename F>
+      auto then(executor& ex, F f) const& {
+         return continue_with(*this, ex, std::move(f), [] { return false; }, anywhere);
+      }
+      template <typename F>
+      auto then(executor& ex, F f) && {
+         return continue_with(std::move(*this), ex, std::move(f), [] { return false; }, anywhere);
+      }
+
+      /**
+         \param run_inline  bool() which is evaluated when this future becomes ready,
+                            if it returns true 'f' is executed by the thread which has published the value instead of being submitted to 'ex'
+                            (unless detail::max_inline_depth continuations are already nested on that thread)
+      */
+      template <typename F, typename P>
+      auto then(executor& ex, F f, P run_inline) const& {
+         return continue_with(*this, ex, std::move(f), std::move(run_inline), anywhere);
+      }
+      template <typename F, typename P>
+      auto then(executor& ex, F f, P run_inline) && {
+         return continue_with(std::move(*this), ex, std::move(f), std::move(run_inline), anywhere);
+      }
+
+      /**
+         \param place  int(const future<T>&) which is evaluated when this future becomes ready and 'f' is not run inline,
+                       'f' is submitted preferably to a worker of the NUMA node it returns (see executor::submit(f, numa_node))
+      */
+      template <typename F, typename P, typename N>
+      auto then(executor& ex, F f, P run_inline, N place) const& {
+         return continue_with(*this, ex, std::move(f), std::move(run_inline), std::move(place));
+      }
+      template <typename F, typename P, typename N>
+      auto then(executor& ex, F f, P run_inline, N place) && {
+         return continue_with(std::move(*this), ex, std::move(f), std::move(run_inline), std::move(place));
+      }
+
+      /**
+         's' is invoked (without an executor) when this future becomes ready
+      */
+      void on_ready(detail::job s) const {
+         s_->on_ready(std::move(s));
+      }
+   };
+
+   template <typename T>
+   class promise {
+      std::shared_ptr<detail::shared_state<T>> s_{std::allocate_shared<detail::shared_state<T>>(detail::pool_allocator<detail::shared_state<T>>{})};
+      bool satisfied_{false};
+
+   public:
+      promise() = default;
+      promise(promise&& other) noexcept
+         : s_(std::move(other.s_)), satisfied_(other.satisfied_) {}
+      promise& operator=(promise&& other) noexcept {
+         promise{std::move(other)}.swap(*this);
+         return *this;
+      }
+      ~promise() {
+         if(s_ && !satisfied_)
+            s_->set_exception(std::make_exception_ptr(std::future_error{std::future_errc::broken_promise}));
+      }
+
+      void swap(promise& other) noexcept {
+         std::swap(s_, other.s_);
+         std::swap(satisfied_, other.satisfied_);
+      }
+
+      future<T> get_future() const {
+         return future<T>{s_};
+      }
+
+      /**
+         The promise counts as satisfied only once the state has taken the value,
+         if a copy (or a move) of the value throws, the destructor still publishes broken_promise
+      */
+      template <typename... Args>
+      void set_value(Args&&... args) {
+         s_->set_value(std::forward<Args>(args)...);
+         satisfied_ = true;
+      }
+      void set_exception(std::exception_ptr e) {
+         s_->set_exception(std::move(e));
+         satisfied_ = true;
+      }
+   };
+
+   template <typename T>
+   future<std::decay_t<T>> make_ready_future(T&& v) {
+      promise<std::decay_t<T>> p;
+      p.set_value(std::forward<T>(v));
+      return p.get_future();
+   }
+
+   /**
+      The same as executor::async but the result is pdag::future<> which supports continuations
+   */
+   template <typename F, typename... Args>
+   auto launch(executor& ex, F&& f, Args&&... args) {
+      using result_type = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+      promise<result_type> p;
+      auto result = p.get_future();
+      ex.submit([f = std::forward<F>(f), prms = std::make_tuple(std::forward<Args>(args)...), p = std::move(p)]() mutable {
+         detail::fulfil(p, [&]() -> decltype(auto) { return std::apply(std::move(f), std::move(prms)); });
+      });
+      return result;
+   }
+
+   /**
+      \return a future which becomes ready when all of 'ftrs...' are ready (either with a value or with an exception).
+              Its value is a tuple of the (ready) input futures.
+   */
+   template <typename... Ts>
+   future<std::tuple<future<Ts>...>> when_all(future<Ts>... ftrs) {
+      using tuple_type = std::tuple<future<Ts>...>;
+      promise<tuple_type> p;
+      auto result = p.get_future();
+      if constexpr(sizeof...(Ts)==0)
+         p.set_value();
+      else {
+         struct all_t {
+            std::atomic<std::size_t>   left{sizeof...(Ts)};
+            tuple_type                 ftrs;
+            promise<tuple_type>        p;
+
+            all_t(promise<tuple_type>&& result, tuple_type&& inputs) noexcept
+               : ftrs(std::move(inputs)), p(std::move(result)) {}
+         };
+         // the inputs are moved in, so they are held by the result only (see future::consume)
+         auto all = std::make_shared<all_t>(std::move(p), tuple_type{std::move(ftrs)...});
+         std::apply([&all](auto&... inputs) {
+            // the last callback moves 'inputs' into the result, none of them is touched after its on_ready()
+            (inputs.on_ready([all] {
+               if(--all->left==0)
+                  all->p.set_value(std::move(all->ftrs));
+            }), ...);
+         }, all->ftrs);
+      }
+      return result;
+   }
+
+}  // namespace pdag
+
+#endif // _PDAG_FUTURE_H__
@@ -0,0 +1,119 @@
+#if !defined(_PDAG_GRANULARITY_H__)
+#define _PDAG_GRANULARITY_H__
+
+#include "executor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace pdag
+{
+   /**
+      Decides whether a node is worth a task of its own.
+      A microsecond-scale node costs less than handing it over to the pool, such a node is better executed inline
+      by the thread which finishes its last dependency.
+
+      The decision is "estimated cost of the node < factor * executor::spawn_overhead()" where the estimated cost is
+         - either a hint given by the user (granularity::cost(...)),
+         - or the moving average of measured durations of the previous invocations (granularity::adaptive(...)).
+           Until the first measurement is taken the node is always spawned.
+
+      Usage Example:
+         auto pconcat = async_adapter(concat, pool);                                      // adaptive by default
+         auto pupper  = async_adapter(upper, pool, granularity::cost(200ns));           // known to be cheap
+         auto pheavy  = async_adapter(heavy, pool, granularity::never_inline());
+   */
+
+   class granularity {
+   public:
+      enum class mode { adaptive, always_inline, never_inline };
+
+   private:
+      using rep_t = std::chrono::nanoseconds::rep;
+
+      mode                 mode_{mode::adaptive};
+      double               factor_{4.};
+      std::atomic<rep_t>   estimate_{-1};    // nanoseconds, negative if unknown yet
+      bool                 measure_{true};
+
+      granularity(mode m, double factor, rep_t estimate, bool measure) noexcept
+         : mode_(m), factor_(factor), estimate_(estimate), measure_(measure) {}
+
+   public:
+      granularity() noexcept = default;
+      granularity(const granularity& other) noexcept
+         : granularity(other.mode_, other.factor_, other.estimate_.load(std::memory_order_relaxed), other.measure_) {}
+      granularity& operator=(const granularity& other) noexcept {
+         mode_    = other.mode_;
+         factor_  = other.factor_;
+         measure_ = other.measure_;
+         estimate_.store(other.estimate_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+         return *this;
+      }
+
+      /**
+         \param factor  a node runs inline while its average duration stays below factor * spawn overhead
+      */
+      static granularity adaptive(double factor = 4.) noexcept {
+         return {mode::adaptive, factor, -1, true};
+      }
+      /**
+         \param estimate  the expected duration of the node given by the user, it is not measured
+      */
+      static granularity cost(std::chrono::nanoseconds estimate, double factor = 1.) noexcept {
+         return {mode::adaptive, factor, estimate.count(), false};
+      }
+      static granularity always_inline() noexcept {
+         return {mode::always_inline, 0., -1, false};
+      }
+      static granularity never_inline() noexcept {
+         return {mode::never_inline, 0., -1, false};
+      }
+
+      /**
+         \return the current estimation of the node duration, negative if it is unknown yet
+      */
+      std::chrono::nanoseconds estimate() const noexcept {
+         return std::chrono::nanoseconds{estimate_.load(std::memory_order_relaxed)};
+      }
+
+      /**
+         \return true if the node should be executed by the calling thread rather than submitted to 'ex'
+      */
+      bool run_inline(const executor& ex) const noexcept {
+         switch(mode_) {
+            case mode::always_inline: return true;
+            case mode::never_inline:  return false;
+            default: break;
+         }
+         const auto e = estimate_.load(std::memory_order_relaxed);
+         return e>=0 && e < factor_ * ex.spawn_overhead().count();
+      }
+
+      /**
+         Invokes 'f' and takes its duration into the estimation (exponential moving average, alpha=1/8).
+         Concurrent updates may lose a sample, that is fine for a heuristic.
+      */
+      template <typename F>
+      decltype(auto) measure(F&& f) {
+         if(!measure_)
+            return std::forward<F>(f)();
+         struct sample_t {
+            granularity&                           g;
+            std::chrono::steady_clock::time_point  start{std::chrono::steady_clock::now()};
+            ~sample_t() {
+               const rep_t d = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+               const auto  e = g.estimate_.load(std::memory_order_relaxed);
+               g.estimate_.store(e<0? d : e + (d-e)/8, std::memory_order_relaxed);
+            }
+         } sample{*this};
+         return std::forward<F>(f)();
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_GRANULARITY_H__
@@ -0,0 +1,317 @@
+#if !defined(_PDAG_GRAPH_H__)
+#define _PDAG_GRAPH_H__
+
+#include "cancellation.h"
+#include "executor.h"
+#include "future.h"
+#include "granularity.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pdag
+{
+   /**
+      A DAG which is built at runtime (e.g. from a config file) rather than written as nested calls at compile time.
+      Every node is a function 'T(const std::vector<T>& inputs)', where inputs are results of its predecessors
+      in order the edges have been added.
+
+      The graph is scheduled on a pool by "critical path first" (a.k.a. HLFET, Highest Level First with Estimated Times) policy:
+      among all ready nodes the one with the longest remaining path to an exit node runs first,
+      the path length is measured by the optional per-node cost hints.
+      So the makespan approaches the critical-path bound on large irregular graphs.
+
+      Usage Example:
+         graph<string> g;
+         auto a = g.add([](auto&) { return create("foo "); }, 3.);
+         auto b = g.add([](auto&) { return create("bar "); }, 3.);
+         auto c = g.add([](auto& in) { return concat(in[0], in[1]); }, 5.);
+         g.add_edge(a, c);
+         g.add_edge(b, c);
+         auto results = g.run(pool).get();   // results[c] == "foo bar "
+
+      \see https://en.wikipedia.org/wiki/Critical_path_method
+      \see Y.-K. Kwok, I. Ahmad, "Static scheduling algorithms for allocating directed task graphs to multiprocessors"
+   */
+
+   template <typename T>
+   class graph {
+   public:
+      using value_type     = T;
+      using node_id        = std::size_t;
+      using function_type  = std::function<T(const std::vector<T>&)>;
+
+   private:
+      struct node_t {
+         function_type        f;
+         double               cost;
+         std::string          name;
+         std::vector<node_id> inputs;
+         std::vector<node_id> outputs;
+         mutable granularity  gr;
+      };
+
+      std::vector<node_t> nodes_;
+
+      /**
+         Kahn's algorithm
+         \throw std::invalid_argument if the graph has a cycle
+      */
+      std::vector<node_id> topological_order() const {
+         std::vector<std::size_t> in(nodes_.size());
+         for(std::size_t i{0}; i<nodes_.size(); ++i)
+            in[i] = nodes_[i].inputs.size();
+         std::vector<node_id> order;
+         order.reserve(nodes_.size());
+         for(node_id i{0}; i<nodes_.size(); ++i)
+            if(in[i]==0)
+               order.push_back(i);
+         for(std::size_t k{0}; k<order.size(); ++k)
+            for(auto o : nodes_[order[k]].outputs)
+               if(--in[o]==0)
+                  order.push_back(o);
+         if(order.size()!=nodes_.size())
+            throw std::invalid_argument{"pdag::graph: the graph has a cycle"};
+         return order;
+      }
+
+      /**
+         rank(n) = cost(n) + max(rank(successors)), i.e. the length of the longest path from 'n' to an exit node
+      */
+      std::vector<double> ranks(const std::vector<node_id>& order) const {
+         std::vector<double> rank(nodes_.size());
+         for(auto it = order.rbegin(); it!=order.rend(); ++it) {
+            double tail{0.};
+            for(auto o : nodes_[*it].outputs)
+               tail = std::max(tail, rank[o]);
+            rank[*it] = nodes_[*it].cost + tail;
+         }
+         return rank;
+      }
+
+      /**
+         State of a single run of the graph
+      */
+      struct run_t : std::enable_shared_from_this<run_t> {
+         using entry_t = std::pair<double, node_id>;  // rank, node
+
+         const graph&                              g;
+         executor&                                 ex;
+         tracer*                                   tr;
+         std::size_t                               trace_run;  // index of the run within 'tr'
+         cancellation_token                        ct;
+         std::vector<tracer::clock::time_point>    ready_at;  // only if it is traced
+         std::vector<double>                       rank;
+         std::unique_ptr<std::atomic<std::size_t>[]> missing;  // number of inputs which are not ready yet
+         std::vector<std::optional<T>>             results;
+         std::atomic<std::size_t>                  left;
+         std::atomic<bool>                         failed{false};
+         std::exception_ptr                        error;
+         bool                                      root_cause{false};  // 'error' is not operation_cancelled
+         promise<std::vector<T>>                   p;
+         std::mutex                                m;
+         std::priority_queue<entry_t>              ready;
+
+         run_t(const graph& g, executor& ex, tracer* tr, cancellation_token ct, std::vector<double> rank)
+            : g(g), ex(ex), tr(tr), trace_run(tr? tr->begin_run(ex.size()) : 0), ct(std::move(ct)), ready_at(tr? g.nodes_.size() : 0), rank(std::move(rank))
+            , missing(new std::atomic<std::size_t>[g.nodes_.size()])
+            , results(g.nodes_.size())
+            , left(g.nodes_.size()) {
+            for(std::size_t i{0}; i<g.nodes_.size(); ++i)
+               missing[i] = g.nodes_[i].inputs.size();
+         }
+
+         /**
+            The node is put into the ready queue and one job is submitted to the pool.
+            The job does not run 'n' itself but the most critical ready node at the moment the job starts.
+         */
+         void make_ready(node_id n) {
+            push(n);
+            dispatch();
+         }
+
+         void push(node_id n) {
+            mark_ready(n);
+            std::lock_guard<std::mutex> l{m};
+            ready.emplace(rank[n], n);
+         }
+
+         void dispatch() {
+            ex.submit([self = this->shared_from_this()] {
+               node_id n;
+               {
+                  std::lock_guard<std::mutex> l{self->m};
+                  n = self->ready.top().second;
+                  self->ready.pop();
+               }
+               self->execute(n);
+            });
+         }
+
+         void mark_ready(node_id n) {
+            if(tr)
+               ready_at[n] = tracer::clock::now();
+         }
+
+         void trace(node_id n, tracer::clock::time_point start) {
+            const auto& node = g.nodes_[n];
+            tr->record({trace_run, n, node.name, node.inputs, ready_at[n], start, tracer::clock::now(),
+                        executor::current()==&ex? static_cast<long>(executor::current_index()) : -1});
+         }
+
+         /**
+            Runs 'first' and then, in the same thread, every successor which becomes ready and is too cheap to be spawned
+         */
+         void execute(node_id first) {
+            std::vector<node_id> inlined{first};
+            while(!inlined.empty()) {
+               const auto  n    = inlined.back();
+               const auto& node = g.nodes_[n];
+               inlined.pop_back();
+               const auto start = tr? tracer::clock::now() : tracer::clock::time_point{};
+               if(!failed) {
+                  try {
+                     std::vector<T> inputs;
+                     inputs.reserve(node.inputs.size());
+                     for(auto i : node.inputs)
+                        inputs.push_back(*results[i]);
+                     results[n].emplace(detail::run_cancellable(ct, [&] {
+                        return node.gr.measure([&] { return node.f(inputs); });
+                     }));
+                  }
+                  catch(const operation_cancelled&) {
+                     fail(std::current_exception(), false);
+                  }
+                  catch(...) {
+                     fail(std::current_exception(), true);
+                  }
+                  if(tr)
+                     trace(n, start);
+               }
+               for(auto o : node.outputs)
+                  if(--missing[o]==0) {
+                     if(g.nodes_[o].gr.run_inline(ex)) {
+                        mark_ready(o);
+                        inlined.push_back(o);
+                     }
+                     else
+                        make_ready(o);
+                  }
+               if(--left==0)
+                  finish();
+            }
+         }
+
+         /**
+            The rest of the nodes are skipped, the root cause of the failure takes precedence over cancellation
+         */
+         void fail(std::exception_ptr e, bool root) {
+            std::lock_guard<std::mutex> l{m};
+            if(!error || (root && !root_cause)) {
+               error      = std::move(e);
+               root_cause = root;
+            }
+            failed = true;
+         }
+
+         void finish() {
+            if(failed) {
+               p.set_exception(error);
+               return;
+            }
+            std::vector<T> out;
+            out.reserve(results.size());
+            for(auto& r : results)
+               out.push_back(std::move(*r));
+            p.set_value(std::move(out));
+         }
+      };
+
+   public:
+      /**
+         \param f     T(const std::vector<T>& inputs)
+         \param cost  an optional estimation of execution time of 'f' (any unit, the same for all nodes)
+         \param name  an optional human readable name
+         \param gr    whether the node is cheap enough to run inline by the thread which finishes its last input (see granularity)
+         \return an identifier of the new node
+      */
+      node_id add(function_type f, double cost = 1., std::string name = {}, granularity gr = {}) {
+         nodes_.push_back(node_t{std::move(f), cost, std::move(name), {}, {}, std::move(gr)});
+         return nodes_.size()-1;
+      }
+
+      /**
+         The result of 'from' becomes the next input of 'to'
+      */
+      void add_edge(node_id from, node_id to) {
+         if(from>=nodes_.size() || to>=nodes_.size())
+            throw std::out_of_range{"pdag::graph::add_edge: unknown node"};
+         nodes_[from].outputs.push_back(to);
+         nodes_[to].inputs.push_back(from);
+      }
+
+      std::size_t size() const noexcept {
+         return nodes_.size();
+      }
+      const std::string& name(node_id n) const {
+         return nodes_.at(n).name;
+      }
+      double cost(node_id n) const {
+         return nodes_.at(n).cost;
+      }
+      const std::vector<node_id>& inputs(node_id n) const {
+         return nodes_.at(n).inputs;
+      }
+      const std::vector<node_id>& outputs(node_id n) const {
+         return nodes_.at(n).outputs;
+      }
+
+      /**
+         \return the sum of cost hints along the longest path, the lower bound of the makespan
+      */
+      double critical_path() const {
+         const auto rank = ranks(topological_order());
+         return rank.empty()? 0. : *std::max_element(rank.begin(), rank.end());
+      }
+
+      /**
+         Schedules all nodes on 'ex'. The graph must outlive the run.
+         \param tr  if it is specified, the run is registered in it (tracer::begin_run) and an event is recorded for every node
+         \param ct  nodes which have not been started are skipped once it is cancelled, a failed node cancels it (see cancellation.h)
+         \return a future of results of all nodes indexed by node_id
+         \throw std::invalid_argument if the graph has a cycle
+      */
+      future<std::vector<T>> run(executor& ex = default_executor(), tracer* tr = nullptr, cancellation_token ct = {}) const {
+         auto r = std::make_shared<run_t>(*this, ex, tr, std::move(ct), ranks(topological_order()));
+         auto result = r->p.get_future();
+         if(nodes_.empty()) {
+            r->p.set_value();
+            return result;
+         }
+         std::size_t roots{0};
+         for(node_id i{0}; i<nodes_.size(); ++i)
+            if(nodes_[i].inputs.empty()) {
+               r->push(i);
+               ++roots;
+            }
+         while(roots--)
+            r->dispatch();
+         return result;
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_GRAPH_H__
@@ -1,96 +1,31 @@
-
-/**
-   Parallelized Direct Acyclic Graph
-   ---------------------------------
-   A tiny automatic parallelization library with std::future
-
-   \see C++17 STL Cookbook by Jacek Galowicz, Ch 9. (https://www.amazon.com/gp/product/178712049X/ref=as_li_ss_tl?ie=UTF8&fpl=fresh&pd_rd_i=178712049X&pd_rd_r=78JC25KCTX86BK1T2QX1&pd_rd_w=O0On9&pd_rd_wg=CSldc&pf_rd_m=ATVPDKIKX0DER&pf_rd_s=&pf_rd_r=HNN13KHDYJSQT8Y7BFC7&pf_rd_t=36701&pf_rd_p=1cf9d009-399c-49e1-901a-7b8786e59436&pf_rd_i=desktop&linkCode=sl1&tag=bfilipek-20&linkId=e82310b0a2b3cb9fcb98312eb1cea33f)
-   \see https://en.wikipedia.org/wiki/Directed_acyclic_graph
+/*
+   g++ main.cpp -std=c++17 -Wextra -Wall -pedantic-errors -pthread -o exe
+   g++ main.cpp -std=c++20 -Wextra -Wall -pedantic-errors -pthread -o exe   <--- + coroutine version
 */
 
-#include <future>
-
-namespace pdag
-{
-   /**
-      Usage Example:
-         An ordinary function with signature: TR f(TA1,TA2,TA3)
-         can be transformed into an asynchronous function object and called as
-
-         auto result = asynchronize(f)(a1,a2,a3)();   
-              ^4                    ^1    ^2       ^3
-         where
-            ^1 - asynchronous version of 'f'. It can be called with the same arguments like 'f'. 
-            ^2 - a collable object which stores 'f', 'a1', 'a2', 'a3'. It does not call anything yet.
-            ^3 - a direct std::async invocation, i.e. semantic meaning of ^3 is "Take the captured function and the arguments, and throw them together into std::async.".
-            ^4 - std::future<TR> object, the result of 'f' can be obtained by calling method get().
-   */
-
-   template <typename F>
-   auto asynchronize(F f) noexcept {
-      return [f](auto... prms) {
-         return [=]() {
-            return std::async(std::launch::async, f, prms...);
-         };
-      };
-   }
-
-   /**
-      It's a collabe object which based on captured 'f', 
-      ^1) i.e it just transform a function 'f' into a function object that accepts a range of agruments.
-      It supposes that all input arguments 'ftrs...' are std::future<...> objects.
-      ^2) This function object does then call .get() on all of the arguments and then finally forwards them to 'f'
-      ^3) returns f(...);
-
-      Usage Example:
-         auto result = future_unwrap(f)(future1,future2,...);   
-              ^3                     ^1 ^2
-   */
-
-   template <typename F>
-   auto future_unwrap(F f) noexcept {
-      return [f](auto... ftrs) {
-         return f(ftrs.get()...);
-      };
-   }
-
-   /**
-      \param afs...  argument list of callable objects without input arguments like asynchronize(f)(a1,a2,a3) mentioned above
-
-      Usage Example:
-         Let's suppose there are two asynchronous function objects
-            auto af1 = asynchronize(func1)(a1,a2,a3);
-            auto af2 = asynchronize(func2)(a1);
-         and function 'TR fun3(...)' that expects results from both of them 
-         then the invocation below means
-
-         auto result = async_adapter(func3)(af1,af2)();   
-              ^4                    ^1     ^2       ^3
-         where
-            ^1 - asynchronous version of 'func3' that mimics 'func3' accepting the same arguments
-            ^2 - another function object that captures 'func3', 'af1', 'af2'
-            ^3 - a direct invocations of 'af1', 'af2' and then std::async  
-                 'af1()', 'af2()' produce future<> values on wich we can call .get by means future_unwrap 
-            ^4 - std::future<TR> object, the result of 'func3' can be obtained by calling method get().
-   */
-
-   template <typename F>
-   auto async_adapter(F f) noexcept {
-      return [f](auto... afs) {
-         return [=]() {
-            return std::async(std::launch::async, future_unwrap(f), afs()...);
-         };
-      };
-   }
-
-
-}  // namespace pdag
-
+#include "pdag.h"
+#include "graph.h"
+#include "algorithm.h"
+#include "pipeline.h"
+#include "static_graph.h"
+#if defined(__cpp_impl_coroutine)
+#include "task.h"
+#endif
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 using namespace chrono_literals;
@@ -166,9 +101,12 @@ string parallelized_version()
 {
    using namespace pdag;
 
-   auto pcreate = asynchronize(create); 
-   auto pconcat = async_adapter(concat); 
-   auto ptwice  = async_adapter(twice); 
+   executor pool{4};    // <--- the simulated functions sleep rather than compute, 4 threads are enough for the optimal schedule
+   tracer   tr;         // <--- every node records when it was ready, started and finished (see trace.h)
+
+   auto pcreate = asynchronize(create, pool, &tr, "create"); 
+   auto pconcat = async_adapter(concat, pool, {}, &tr, "concat"); 
+   auto ptwice  = async_adapter(twice, pool, {}, &tr, "twice"); 
 
    const auto res = 
       pconcat(
@@ -183,9 +121,334 @@ string parallelized_version()
             pcreate("that ")
          )
       );
+   const auto s = res().get();
+   tr.report_critical_path(cout);
+   return s;
+}
+
+string diamond_version()
+{
+   using namespace pdag;
+
+   executor pool{4};
+
+   auto pcreate = asynchronize(create, pool); 
+   auto pconcat = async_adapter(concat, pool); 
+   auto ptwice  = async_adapter(twice, pool); 
+
+   const auto foobar = pconcat(pcreate("foo "), pcreate("bar "));  // <--- feeds two consumers but it is computed once
+   const auto res = 
+      pconcat(
+         ptwice(foobar),
+         foobar
+      );
    return res().get();
 }
 
+string deadline_version()
+{
+   using namespace pdag;
+
+   executor pool{4};
+
+   auto pcreate = asynchronize(create, pool); 
+   auto pconcat = async_adapter(concat, pool); 
+   auto ptwice  = async_adapter(twice, pool); 
+
+   const auto res = 
+      pconcat(
+         ptwice(
+            pconcat(
+               pcreate("foo "),
+               pcreate("bar ")
+            )
+         ),
+         pconcat(
+            pcreate("this "),
+            pcreate("that ")
+         )
+      );
+
+   cancellation_source cs;
+   cs.cancel_after(4s);  // <--- 'create' are done by then, started 'concat' run to completion, the rest is skipped
+   try {
+      return res(cs.token()).get();
+   }
+   catch(const operation_cancelled& e) {
+      return e.what();
+   }
+}
+
+/**
+   The same DAG as above described by a "config file", i.e. its shape is known at runtime only.
+   Each line: <node> <function> <arguments...>, where an argument is either a word (for 'create') or a name of other node
+*/
+const char* dag_config = R"(
+   a   create foo
+   b   create bar
+   c   concat a b
+   d   twice  c
+   e   create this
+   f   create that
+   g   concat e f
+   res concat d g
+)";
+
+string runtime_graph_version()
+{
+   using namespace pdag;
+   using node_id = graph<string>::node_id;
+
+   executor       pool{4};
+   graph<string>  g;
+   map<string,node_id> ids;
+
+   istringstream config{dag_config};
+   for(string line; getline(config, line);) {
+      istringstream words{line};
+      string name, fn, arg;
+      if(!(words >> name >> fn))
+         continue;
+      if(fn=="create") {
+         words >> arg;
+         ids[name] = g.add([w = arg + " "](auto&) { return create(w); }, 3., name);
+         continue;
+      }
+      if(fn=="concat")
+         ids[name] = g.add([](auto& in) { return concat(in[0], in[1]); }, 5., name);
+      else if(fn=="twice")
+         ids[name] = g.add([](auto& in) { return twice(in[0]); }, 3., name);
+      else
+         throw invalid_argument{"unknown function: " + fn};
+      while(words >> arg)
+         g.add_edge(ids.at(arg), ids[name]);
+   }
+   tracer tr;
+   const auto res = g.run(pool, &tr).get()[ids.at("res")];
+   tr.export_chrome(ofstream{"dag_trace.json"});   // <--- chrome://tracing or https://ui.perfetto.dev
+   tr.report_critical_path(cout);
+   return res;
+}
+
+/**
+   The same DAG with a shape fixed at compile time: levels are computed by the compiler,
+   results live on the stack and nodes are plain function calls
+*/
+string create_foo()  { return create("foo "); }
+string create_bar()  { return create("bar "); }
+string create_this() { return create("this "); }
+string create_that() { return create("that "); }
+
+string static_graph_version()
+{
+   using namespace pdag;
+   using dag = static_graph<
+      snode<create_foo>,         // 0
+      snode<create_bar>,         // 1
+      snode<concat, 0, 1>,       // 2
+      snode<twice, 2>,           // 3
+      snode<create_this>,        // 4
+      snode<create_that>,        // 5
+      snode<concat, 4, 5>,       // 6
+      snode<concat, 3, 6>        // 7  <--- res
+   >;
+   static_assert(dag::depth()==4, "create, concat, twice, concat");
+
+   executor pool{4};
+   return get<7>(dag::run(pool));
+}
+
+/**
+   A stream of items through create -> concat -> twice, every stage is a thread of its own.
+   Item N+1 is created while item N is concatenated, so 3 items take 3+5+3 + 2*5 secs instead of 3*11.
+*/
+string streaming_version()
+{
+   using namespace pdag;
+
+   auto p = pipeline<string>{4}
+               .stage([](string s) { return create(s); },       "create")
+               .stage([](string s) { return concat(s, s); },    "concat")
+               .stage([](string s) { return twice(s); },        "twice");
+
+   thread producer{[&p] {
+      for(auto w : {"foo ", "bar ", "baz "})
+         p.push(w);
+      p.close();
+   }};
+   string res;
+   while(auto r = p.pop())
+      res += *r + "| ";
+   producer.join();
+   p.report(cout);
+   return res;
+}
+
+/**
+   A large intermediate result which counts its copies.
+   A single consumer takes a result by value, so it is moved along the DAG, a move-only payload flows as well.
+*/
+struct payload
+{
+   inline static atomic<size_t> copies{0};
+   string data;
+
+   explicit payload(string s) : data{move(s)} {}
+   payload(const payload& other) : data{other.data} { ++copies; }
+   payload(payload&&) noexcept = default;
+   payload& operator=(const payload& other) { data = other.data; ++copies; return *this; }
+   payload& operator=(payload&&) noexcept = default;
+};
+
+string zero_copy_version()
+{
+   using namespace pdag;
+
+   executor pool{4};
+
+   auto pmake = asynchronize([](size_t n, char c) { return payload{string(n, c)}; }, pool);
+   auto pjoin = async_adapter([](payload a, payload b) { a.data += b.data; return a; }, pool);
+   auto pbox  = async_adapter([](payload p) { return make_unique<payload>(move(p)); }, pool);     // <--- move-only result
+   auto psize = async_adapter([](unique_ptr<payload> p) { return p->data.size(); }, pool);
+
+   const auto mb = size_t{1}<<20;
+   const auto res = psize(pbox(pjoin(pjoin(pmake(mb, 'a'), pmake(mb, 'b')), pmake(mb, 'c'))));
+   const auto size = res().get();
+   if(size!=3*mb || payload::copies!=0)
+      throw logic_error{"a payload is lost or copied"};
+   return to_string(size) + " bytes, " + to_string(payload::copies) + " copies";
+}
+
+/**
+   A single stage over 10M elements: split into cache-sized chunks which run on the pool
+*/
+string data_parallel_version()
+{
+   using namespace pdag;
+
+   executor pool;
+
+   auto pgen    = asynchronize([](size_t n) { vector<double> v(n); iota(begin(v), end(v), 1.); return v; }, pool);
+   auto pinvert = parallel_map([](double x) { return 1./(x*x); }, pool);
+   auto psum    = parallel_reduce(plus<>{}, 0., pool);
+
+   const auto res = psum(pinvert(pgen(10'000'000)));
+   return "sum(1/x^2) = " + to_string(res().get());   // <--- pi^2/6
+}
+
+/**
+   The same stages on a pool pinned to cores: a successor is queued on the NUMA node which holds its largest input
+*/
+string numa_version()
+{
+   using namespace pdag;
+
+   const auto topology = cpu_topology::detect();
+   executor pool{topology.cpu_count(), topology};
+
+   auto pgen    = asynchronize([](size_t n) { vector<double> v(n); iota(begin(v), end(v), 1.); return v; }, pool);
+   auto pinvert = parallel_map([](double x) { return 1./(x*x); }, pool);
+   auto psum    = parallel_reduce(plus<>{}, 0., pool);
+
+   const auto res = psum(pinvert(pgen(10'000'000)));
+   return to_string(topology.nodes()) + " NUMA node(s), " + to_string(topology.cpu_count()) + " cpu(s), sum(1/x^2) = " + to_string(res().get());
+}
+
+/**
+   The DAG of parallelized_version() rerun with memoized nodes: the second run changes "that " only,
+   so create("that "), both concats above it are recomputed and the "foo bar" branch is taken from the cache as a whole
+*/
+string memo_version()
+{
+   using namespace pdag;
+
+   executor pool{4};
+   memo_cache cache;
+
+   auto pcreate = asynchronize(create, cache, pool);
+   auto pconcat = async_adapter(concat, cache, pool);
+   auto ptwice  = async_adapter(twice, cache, pool);
+
+   const auto run = [&](string_view last) {
+      return pconcat(ptwice(pconcat(pcreate("foo "), pcreate("bar "))), pconcat(pcreate("this "), pcreate(last)))().get();
+   };
+
+   run("that ");
+   const auto computed = cache.misses();
+   stopwatch st;
+   const auto res = run("those ");
+   const auto recomputed = cache.misses()-computed;
+   if(recomputed!=3)
+      throw logic_error{"an unchanged node is recomputed"};
+   return res + "(" + to_string(recomputed) + " of " + to_string(computed) + " nodes recomputed in " + to_string(st.secs()) + " seconds)";
+}
+
+/**
+   A chain of 100k cheap links from a single promise. 'granularity::adaptive' measures the first links and then runs the rest inline
+   by the thread which publishes the previous link. Nested inline continuations are bounded (detail::max_inline_depth),
+   beyond that bound a link is submitted to the pool, so the chain does not overflow the stack of the publishing thread.
+*/
+string granularity_version()
+{
+   using namespace pdag;
+
+   executor pool{4};
+
+   const size_t links{100'000};
+   granularity gr;
+   atomic<size_t> inlined{0};
+
+   pdag::promise<size_t> p;
+   auto res = p.get_future();
+   for(size_t i{0}; i<links; ++i)
+      res = res.then(pool, [&gr](pdag::future<size_t> x) { return gr.measure([&] { return x.get()+1; }); },
+                           [&] { return gr.run_inline(pool) && (++inlined, true); });
+   p.set_value(0);
+   if(res.get()!=links)
+      throw logic_error{"a link of the chain is lost"};
+   return to_string(links) + " links, " + to_string(inlined.load()) + " inline, " + to_string(gr.estimate().count()) + " ns per link, "
+        + to_string(pool.spawn_overhead().count()) + " ns per spawn";
+}
+
+#if defined(__cpp_impl_coroutine)
+
+/**
+   The same DAG where every stage is a coroutine which co_awaits its inputs.
+   A suspended stage holds no thread, only 'create' and 'concat' being executed occupy workers of the pool.
+*/
+pdag::task<string> ccreate(pdag::executor&, string_view s) {
+   co_return create(s);
+}
+pdag::task<string> cconcat(pdag::executor&, pdag::task<string> a, pdag::task<string> b) {
+   co_return concat(co_await a, co_await b);
+}
+pdag::task<string> ctwice(pdag::executor&, pdag::task<string> a) {
+   co_return twice(co_await a);
+}
+
+string coroutine_version()
+{
+   pdag::executor pool{4};
+   auto& p = pool;
+
+   const auto res = 
+      cconcat(p,
+         ctwice(p,
+            cconcat(p,
+               ccreate(p, "foo "),
+               ccreate(p, "bar ")
+            )
+         ),
+         cconcat(p,
+            ccreate(p, "this "),
+            ccreate(p, "that ")
+         )
+      );
+   return res.get();
+}
+
+#endif
+
 int main()
 {
    stopwatch st;
@@ -195,4 +458,50 @@ int main()
    st.start();
    cout << parallelized_version() << endl
         << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << diamond_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << deadline_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << runtime_graph_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << static_graph_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << streaming_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << zero_copy_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << data_parallel_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << numa_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << memo_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+   st.start();
+   cout << granularity_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+
+#if defined(__cpp_impl_coroutine)
+   st.start();
+   cout << coroutine_version() << endl
+        << "*** time elapsed: " << st.secs() << " seconds" << endl;
+#endif
 }
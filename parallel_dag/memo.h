@@ -0,0 +1,256 @@
+#if !defined(_PDAG_MEMO_H__)
+#define _PDAG_MEMO_H__
+
+#include "future.h"
+
+#include <any>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+/**
+   Incremental recomputation of a DAG which is rerun many times with only a few inputs changed.
+
+   Every memoized node has an identity (a key) which is known before anything is computed:
+      key(leaf)     = {f, arguments...}
+      key(interior) = {f, key(input1), key(input2), ...}
+   A node whose key is found in memo_cache returns the cached future right away and does not launch its inputs at all.
+   So a rerun recomputes only the dirty subgraph, i.e. nodes downstream of the changed arguments.
+   A key keeps copies of the arguments, the hash only picks the bucket and keys are compared by value on lookup,
+   so a hash collision never returns the result of another node.
+
+   Usage Example:
+      memo_cache cache;
+      auto pcreate = asynchronize(create, cache, pool);
+      auto pconcat = async_adapter(concat, cache, pool);
+
+      pconcat(pcreate("foo "), pcreate("bar "))().get();  // 3 calls
+      pconcat(pcreate("foo "), pcreate("baz "))().get();  // 2 calls: create("baz "), concat
+
+   Note:
+      - the identity of 'f' is its value for a function pointer or an equality comparable function object,
+        its type for a stateless one (e.g. a lambda without captures); a lambda with captures is rejected at compile time;
+      - arguments must be copyable, equality comparable and hashable by std::hash (character pointers and arrays are kept as strings);
+      - a failed or cancelled result is not reused.
+*/
+
+namespace pdag
+{
+   namespace detail
+   {
+      inline std::size_t hash_combine(std::size_t seed, std::size_t v) noexcept {
+         return seed ^ (v + 0x9e3779b97f4a7c15ull + (seed<<6) + (seed>>2));
+      }
+
+      template <typename T, typename = void>
+      struct is_equality_comparable : std::false_type {};
+      template <typename T>
+      struct is_equality_comparable<T, std::void_t<decltype(bool(std::declval<const T&>()==std::declval<const T&>()))>> : std::true_type {};
+
+      /**
+         The type an argument is kept as within a key, a character string is copied rather than referred to by a pointer
+      */
+      template <typename T>
+      using key_value_t = std::conditional_t<std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>,
+                                             std::string, std::decay_t<T>>;
+
+      template <typename T>
+      std::size_t hash_value(const T& v) {
+         static_assert(std::is_invocable_v<std::hash<T>, const T&>, "pdag::memo_cache: an argument is not hashable by std::hash");
+         static_assert(is_equality_comparable<T>::value, "pdag::memo_cache: an argument is not equality comparable");
+         return std::hash<T>{}(v);
+      }
+
+      /**
+         true if a callable object can be identified: it is stateless or its state is equality comparable
+      */
+      template <typename F>
+      inline constexpr bool has_identity_v = std::is_empty_v<F> || is_equality_comparable<F>::value;
+
+      /**
+         Identity of a callable object: nothing but its type if it is stateless, otherwise its value
+      */
+      template <typename F>
+      class callable_id {
+         static_assert(has_identity_v<F>,
+                       "pdag::memo_cache: a stateful callable has no identity, use a function pointer, a lambda without captures "
+                       "or an equality comparable function object");
+         std::conditional_t<std::is_empty_v<F>, std::tuple<>, F> f_;
+      public:
+         explicit callable_id(const F& f) : f_([&]() -> decltype(auto) {
+            if constexpr(std::is_empty_v<F>)
+               return std::tuple<>{};
+            else
+               return f;
+         }()) {}
+
+         std::size_t hash() const noexcept {
+            const auto k = typeid(F).hash_code();
+            if constexpr(std::is_pointer_v<F>)
+               return hash_combine(k, std::hash<F>{}(f_));
+            else
+               return k;
+         }
+         bool operator==(const callable_id& other) const {
+            if constexpr(std::is_empty_v<F>)
+               return true;
+            else
+               return f_==other.f_;
+         }
+      };
+
+      struct key_base {
+         const std::size_t hash;
+         explicit key_base(std::size_t h) noexcept : hash(h) {}
+         virtual ~key_base() = default;
+         virtual bool equals(const key_base& other) const = 0;
+      };
+
+      /**
+         \tparam Values  arguments of a leaf node or keys of inputs of an interior node
+      */
+      template <bool Interior, typename F, typename... Values>
+      class key_of_node final : public key_base {
+         callable_id<F>          f_;
+         std::tuple<Values...>   values_;
+      public:
+         template <typename... Args>
+         key_of_node(std::size_t h, const F& f, const Args&... values) : key_base(h), f_(f), values_(values...) {}
+
+         bool equals(const key_base& other) const override {
+            const auto* k = dynamic_cast<const key_of_node*>(&other);
+            return k && f_==k->f_ && values_==k->values_;
+         }
+      };
+   }  // namespace detail
+
+   /**
+      Identity of a memoized node, empty if the node is not memoized.
+      Keys of interior nodes refer to keys of their inputs, so equal keys stand for equal subgraphs.
+   */
+   class memo_key {
+      std::shared_ptr<const detail::key_base> k_;
+   public:
+      memo_key() noexcept = default;
+      explicit memo_key(std::shared_ptr<const detail::key_base> k) noexcept : k_(std::move(k)) {}
+
+      explicit operator bool() const noexcept {
+         return static_cast<bool>(k_);
+      }
+      std::size_t hash() const noexcept {
+         return k_? k_->hash : 0;
+      }
+
+      friend bool operator==(const memo_key& a, const memo_key& b) {
+         if(a.k_==b.k_)
+            return true;   // <-- the same key, e.g. interned by memo_cache
+         return a.k_ && b.k_ && a.k_->hash==b.k_->hash && a.k_->equals(*b.k_);
+      }
+      friend bool operator!=(const memo_key& a, const memo_key& b) {
+         return !(a==b);
+      }
+
+      struct hasher {
+         std::size_t operator()(const memo_key& k) const noexcept {
+            return k.hash();
+         }
+      };
+   };
+
+   namespace detail
+   {
+      /**
+         \return the key of a leaf node 'f(prms...)'
+      */
+      template <typename F, typename... Args>
+      memo_key leaf_key(const F& f, const Args&... prms) {
+         auto seed = callable_id<F>{f}.hash();
+         ((seed = hash_combine(seed, hash_value(key_value_t<Args>(prms)))), ...);
+         return memo_key{std::make_shared<key_of_node<false, F, key_value_t<Args>...>>(seed, f, prms...)};
+      }
+
+      /**
+         \return the key of an interior node 'f(inputs...)', an empty one if any of inputs has no identity
+      */
+      template <typename F, typename... Keys>
+      memo_key interior_key(const F& f, const Keys&... keys) {
+         if((!keys || ...))
+            return {};
+         auto seed = hash_combine(callable_id<F>{f}.hash(), 0x5bd1e995);
+         ((seed = hash_combine(seed, keys.hash())), ...);
+         return memo_key{std::make_shared<key_of_node<true, F, Keys...>>(seed, f, keys...)};
+      }
+   }  // namespace detail
+
+   class memo_cache {
+      mutable std::mutex                                             m_;
+      std::unordered_map<memo_key, std::any, memo_key::hasher>      entries_;    // key -> pdag::future<T>
+      std::atomic<std::size_t>                                       hits_{0};
+      std::atomic<std::size_t>                                       misses_{0};
+
+   public:
+      /**
+         \return the equal key stored in the cache if there is one, otherwise 'key' itself.
+         A node keyed by the stored key lets its consumers compare their keys by address rather than walk the whole upstream subgraph.
+      */
+      memo_key intern(memo_key key) const {
+         std::lock_guard<std::mutex> l{m_};
+         const auto it = entries_.find(key);
+         return it!=entries_.end()? it->first : key;
+      }
+
+      /**
+         \return the cached future (it may be still in flight), nothing if it is unknown or it has failed
+      */
+      template <typename T>
+      std::optional<future<T>> find(const memo_key& key) {
+         std::lock_guard<std::mutex> l{m_};
+         const auto it = entries_.find(key);
+         if(it!=entries_.end())
+            if(const auto* ftr = std::any_cast<future<T>>(&it->second); ftr && !ftr->has_exception()) {
+               ++hits_;
+               return *ftr;
+            }
+         ++misses_;
+         return std::nullopt;
+      }
+
+      template <typename T>
+      void insert(const memo_key& key, future<T> ftr) {
+         std::lock_guard<std::mutex> l{m_};
+         entries_.insert_or_assign(key, std::move(ftr));
+      }
+
+      void erase(const memo_key& key) {
+         std::lock_guard<std::mutex> l{m_};
+         entries_.erase(key);
+      }
+      void clear() {
+         std::lock_guard<std::mutex> l{m_};
+         entries_.clear();
+      }
+      std::size_t size() const {
+         std::lock_guard<std::mutex> l{m_};
+         return entries_.size();
+      }
+      std::size_t hits() const noexcept {
+         return hits_;
+      }
+      std::size_t misses() const noexcept {
+         return misses_;
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_MEMO_H__
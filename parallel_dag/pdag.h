@@ -0,0 +1,488 @@
+#if !defined(_PDAG_H__)
+#define _PDAG_H__
+
+/**
+   Parallelized Direct Acyclic Graph
+   ---------------------------------
+   A tiny automatic parallelization library with futures and continuations
+
+   \see C++17 STL Cookbook by Jacek Galowicz, Ch 9. (https://www.amazon.com/gp/product/178712049X/ref=as_li_ss_tl?ie=UTF8&fpl=fresh&pd_rd_i=178712049X&pd_rd_r=78JC25KCTX86BK1T2QX1&pd_rd_w=O0On9&pd_rd_wg=CSldc&pf_rd_m=ATVPDKIKX0DER&pf_rd_s=&pf_rd_r=HNN13KHDYJSQT8Y7BFC7&pf_rd_t=36701&pf_rd_p=1cf9d009-399c-49e1-901a-7b8786e59436&pf_rd_i=desktop&linkCode=sl1&tag=bfilipek-20&linkId=e82310b0a2b3cb9fcb98312eb1cea33f)
+   \see https://en.wikipedia.org/wiki/Directed_acyclic_graph
+*/
+
+#include "cancellation.h"
+#include "executor.h"
+#include "future.h"
+#include "granularity.h"
+#include "memo.h"
+#include "trace.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pdag
+{
+   /**
+      A handle to a DAG node.
+      The computation is launched by the first call of operator() only, every other call (from any copy of the handle)
+      returns the same shared future. Thus, a node which feeds several consumers (fan-out, diamond-shaped graphs)
+      is computed exactly once.
+
+      The launch takes an optional cancellation_token which flows to all upstream nodes (see cancellation.h),
+      the token of the very first call is used.
+
+      Usage Example:
+         auto foo = pcreate("foo ");            // nothing is launched yet
+         auto res = pconcat(foo, ptwice(foo));  // 'create("foo ")' is computed once for both consumers
+         res().get();                           // or res(token).get()
+   */
+
+   template <typename T>
+   class node {
+      struct state_t {
+         std::once_flag                                                   once;
+         detail::unique_function<future<T>(const cancellation_token&)>   launch;
+         future<T>                                                        result;
+         memo_key                                                         key;
+         std::size_t                                                      trace_id;
+      };
+      std::shared_ptr<state_t> s_{std::make_shared<state_t>()};
+
+   public:
+      using value_type = T;
+
+      /**
+         \param key       identity of the node result for memoization (see memo.h), empty if the node is not memoized
+         \param trace_id  id of the node within its tracer (see trace.h), tracer::no_node if the node is not traced
+      */
+      template <typename L, typename = std::enable_if_t<!std::is_same_v<std::decay_t<L>, node>>>
+      explicit node(L&& launch, memo_key key = {}, std::size_t trace_id = tracer::no_node) {
+         s_->launch   = std::forward<L>(launch);
+         s_->key      = std::move(key);
+         s_->trace_id = trace_id;
+      }
+
+      const memo_key& key() const noexcept {
+         return s_->key;
+      }
+      std::size_t trace_id() const noexcept {
+         return s_->trace_id;
+      }
+
+      /**
+         \return the shared future of the node, the computation is launched by the very first call
+      */
+      future<T> operator()(const cancellation_token& ct = {}) const& {
+         launch_once(ct);
+         return s_->result;
+      }
+
+      /**
+         The last handle of a node hands its future over instead of sharing it,
+         so the consumer may become the sole owner of the result and move it out (see future::consume)
+      */
+      future<T> operator()(const cancellation_token& ct = {}) && {
+         launch_once(ct);
+         if(s_.use_count()==1)
+            return std::move(s_->result);
+         return s_->result;
+      }
+
+   private:
+      void launch_once(const cancellation_token& ct) const {
+         std::call_once(s_->once, [s = s_.get(), &ct] {
+            s->result = s->launch(ct);
+            s->launch = {};   // <-- releases captured arguments and upstream nodes
+         });
+      }
+   };
+
+   /**
+      \param launch  a callable object 'pdag::future<T>(const cancellation_token&)'
+      \param key       identity of the node result, empty if the node is not memoized
+      \param trace_id  id of the node within its tracer, tracer::no_node if the node is not traced
+      \return node<T>
+   */
+   template <typename L>
+   auto make_node(L&& launch, memo_key key = {}, std::size_t trace_id = tracer::no_node) {
+      using future_type = std::invoke_result_t<std::decay_t<L>&, const cancellation_token&>;
+      return node<typename future_type::value_type>{std::forward<L>(launch), std::move(key), trace_id};
+   }
+
+   namespace detail
+   {
+      template <typename AF>
+      memo_key key_of(const AF&) noexcept {
+         return {};
+      }
+      template <typename T>
+      memo_key key_of(const node<T>& n) noexcept {
+         return n.key();
+      }
+
+      template <typename AF>
+      std::size_t trace_id_of(const AF&) noexcept {
+         return tracer::no_node;
+      }
+      template <typename T>
+      std::size_t trace_id_of(const node<T>& n) noexcept {
+         return n.trace_id();
+      }
+
+      /**
+         Where a node of asynchronize/async_adapter records its event, nothing is recorded if 'tr' is nullptr
+      */
+      struct node_trace {
+         tracer*                    tr{nullptr};
+         std::size_t                id{tracer::no_node};
+         std::string                name;
+         std::vector<std::size_t>   inputs;   // ids of traced input nodes
+
+         /**
+            Invokes 'f' and records the event of the node into the latest run of 'tr':
+            'ready' as it is given, start and end around 'f', the worker of 'ex' which runs it. A failed 'f' is recorded too.
+         */
+         template <typename F>
+         decltype(auto) operator()(executor& ex, tracer::clock::time_point ready, F&& f) const {
+            if(!tr)
+               return std::forward<F>(f)();
+            struct record_t {
+               const node_trace&           t;
+               executor&                   ex;
+               tracer::clock::time_point   ready;
+               tracer::clock::time_point   start{tracer::clock::now()};
+               ~record_t() {
+                  try {
+                     t.tr->record({t.tr->current_run(ex.size()), t.id, t.name, t.inputs, ready, start, tracer::clock::now(),
+                                   executor::current()==&ex? static_cast<long>(executor::current_index()) : -1});
+                  }
+                  catch(...) {
+                     // <-- an event which cannot be stored is lost, the node does not fail because of it
+                  }
+               }
+            } record{*this, ex, ready};
+            return std::forward<F>(f)();
+         }
+      };
+
+      /**
+         Returns the cached result of the node 'key' or launches a new computation and puts it into the cache
+      */
+      template <typename L>
+      auto memoized(memo_cache* cache, const memo_key& key, L&& launch) {
+         using future_type = std::invoke_result_t<L&&>;
+         if(!cache || !key)
+            return std::forward<L>(launch)();
+         if(auto cached = cache->find<typename future_type::value_type>(key))
+            return *cached;
+         auto result = std::forward<L>(launch)();
+         cache->insert(key, result);
+         return result;
+      }
+
+      /**
+         Arguments are forwarded into the node and moved from there into 'f' (a node is launched once),
+         so an rvalue argument is never copied and move-only arguments (e.g. std::unique_ptr) are supported.
+         Arguments have to be hashable only if the node is 'Memoized'.
+      */
+      template <bool Memoized, typename F>
+      auto asynchronize(F f, executor& ex, memo_cache* cache, tracer* tr, std::string name) noexcept {
+         return [f, &ex, cache, tr, name = std::move(name)](auto&&... prms) {
+            memo_key key;
+            if constexpr(Memoized)
+               key = cache->intern(leaf_key(f, prms...));
+            node_trace trace{tr, tr? tr->add_node() : tracer::no_node, name, {}};
+            const auto id = trace.id;
+            return make_node([f, &ex, cache, key, trace = std::move(trace), args = std::make_tuple(std::forward<decltype(prms)>(prms)...)](const cancellation_token& ct) mutable {
+               return memoized(cache, key, [&] {
+                  const auto ready = trace.tr? tracer::clock::now() : tracer::clock::time_point{};   // <-- a leaf is ready once it is launched
+                  return std::apply([&](auto&... prms) {
+                     return launch(ex, [f, ct, &ex, trace = std::move(trace), ready](auto&&... prms) {
+                        return trace(ex, ready, [&]() -> decltype(auto) {
+                           return run_cancellable(ct, [&]() -> decltype(auto) { return f(std::forward<decltype(prms)>(prms)...); });
+                        });
+                     }, std::move(prms)...);
+                  }, args);
+               });
+            }, key, id);
+         };
+      }
+
+      /**
+         Launches an input of a node passing the token through, if the input does accept it
+      */
+      template <typename AF>
+      auto launch_input(AF&& af, const cancellation_token& ct) {
+         if constexpr(std::is_invocable_v<AF&&, const cancellation_token&>)
+            return std::forward<AF>(af)(ct);
+         else
+            return std::forward<AF>(af)();
+      }
+
+      /**
+         Rethrows the root cause among failed (ready) inputs,
+         operation_cancelled only if there is nothing else, e.g. "boom" rather than "cancelled because of boom"
+      */
+      template <typename... Ts>
+      void rethrow_input_error(const std::tuple<future<Ts>...>& ftrs) {
+         bool cancelled{false};
+         std::apply([&](const auto&... f) {
+            ([&] {
+               try {
+                  f.get();
+               }
+               catch(const operation_cancelled&) {
+                  cancelled = true;
+               }
+            }(), ...);
+         }, ftrs);
+         if(cancelled)
+            throw operation_cancelled{};
+      }
+
+      template <typename T, typename = void>
+      struct has_size : std::false_type {};
+
+      template <typename T>
+      struct has_size<T, std::void_t<typename T::value_type, decltype(std::declval<const T&>().size())>> : std::true_type {};
+
+      /**
+         A rough footprint of a value, the elements of a container are counted too
+      */
+      template <typename T>
+      std::size_t payload_bytes(const T& v) {
+         if constexpr(has_size<T>::value)
+            return sizeof(T) + v.size() * sizeof(typename T::value_type);
+         else
+            return sizeof(T);
+      }
+
+      /**
+         \return the NUMA node where the largest of the (ready) inputs has been produced, -1 if it is unknown
+      */
+      template <typename... Ts>
+      int numa_node_of_largest(const std::tuple<future<Ts>...>& ftrs) {
+         int node{-1};
+         std::size_t largest{0};
+         std::apply([&](const auto&... f) {
+            ([&] {
+               if(f.has_exception())
+                  return;
+               std::size_t bytes{0};
+               if constexpr(!std::is_void_v<typename std::decay_t<decltype(f)>::value_type>)
+                  bytes = payload_bytes(f.get());
+               if(f.numa_node()>=0 && (node<0 || bytes>largest)) {
+                  node    = f.numa_node();
+                  largest = bytes;
+               }
+            }(), ...);
+         }, ftrs);
+         return node;
+      }
+   }  // namespace detail
+
+   /**
+      Usage Example:
+         An ordinary function with signature: TR f(TA1,TA2,TA3)
+         can be transformed into an asynchronous function object and called as
+
+         auto result = asynchronize(f)(a1,a2,a3)();
+              ^4                    ^1    ^2       ^3
+         where
+            ^1 - asynchronous version of 'f'. It can be called with the same arguments like 'f'.
+            ^2 - a node<TR> which stores 'f', 'a1', 'a2', 'a3'. It does not call anything yet.
+            ^3 - a direct pdag::launch invocation, i.e. semantic meaning of ^3 is "Take the captured function and the arguments, and throw them together into the pool.".
+                 Subsequent invocations return the same future, 'f' is called only once.
+                 ^3 may take a cancellation_token, 'f' is skipped if the token is cancelled before 'f' starts (see cancellation.h)
+            ^4 - pdag::future<TR> object, the result of 'f' can be obtained by calling method get().
+
+      \param ex    a pool of threads where 'f' is executed, default_executor() if it is not specified
+      \param tr    if it is specified, every node records an event named 'name' into the latest run of 'tr' (see trace.h)
+   */
+
+   template <typename F>
+   auto asynchronize(F f, executor& ex = default_executor(), tracer* tr = nullptr, std::string name = {}) noexcept {
+      return detail::asynchronize<false>(std::move(f), ex, nullptr, tr, std::move(name));
+   }
+
+   /**
+      The same as above but nodes are memoized in 'cache' keyed by 'f' and its arguments (see memo.h),
+      i.e. asynchronize(f, cache)(a1,a2,a3)() returns the cached result of the previous run if there is one.
+   */
+
+   template <typename F>
+   auto asynchronize(F f, memo_cache& cache, executor& ex = default_executor(), tracer* tr = nullptr, std::string name = {}) noexcept {
+      static_assert(detail::has_identity_v<F>, "pdag::memo_cache: a stateful callable has no identity (see memo.h)");
+      return detail::asynchronize<true>(std::move(f), ex, &cache, tr, std::move(name));
+   }
+
+   /**
+      It's a collabe object which based on captured 'f',
+      ^1) i.e it just transform a function 'f' into a function object that accepts a range of agruments.
+      It supposes that all input arguments 'ftrs...' are ready pdag::future<...> objects.
+      ^2) This function object does then call .get() on all of the arguments (it never blocks) and then finally forwards them to 'f'.
+          A parameter of 'f' taken by value receives the value moved out of its future if the future is the sole owner of it
+          (see future::consume), i.e. intermediate results flow through the DAG without copies.
+      ^3) returns f(...);
+
+      Usage Example:
+         auto result = future_unwrap(f)(future1,future2,...);
+              ^3                     ^1 ^2
+   */
+
+   namespace detail
+   {
+      /**
+         std::tuple of parameter types of 'F' if they can be deduced, i.e. 'F' is a function
+         or a class with a single non-template operator() (a non-generic lambda), void otherwise
+      */
+      template <typename F, typename = void>
+      struct parameters_of {
+         using type = void;
+      };
+      template <typename R, typename... A>
+      struct parameters_of<R(*)(A...)> {
+         using type = std::tuple<A...>;
+      };
+      template <typename R, typename... A>
+      struct parameters_of<R(*)(A...) noexcept> : parameters_of<R(*)(A...)> {};
+      template <typename C, typename R, typename... A>
+      struct parameters_of<R(C::*)(A...)> : parameters_of<R(*)(A...)> {};
+      template <typename C, typename R, typename... A>
+      struct parameters_of<R(C::*)(A...) const> : parameters_of<R(*)(A...)> {};
+      template <typename C, typename R, typename... A>
+      struct parameters_of<R(C::*)(A...) noexcept> : parameters_of<R(*)(A...)> {};
+      template <typename C, typename R, typename... A>
+      struct parameters_of<R(C::*)(A...) const noexcept> : parameters_of<R(*)(A...)> {};
+      template <typename F>
+      struct parameters_of<F, std::void_t<decltype(&F::operator())>> : parameters_of<decltype(&F::operator())> {};
+
+      /**
+         true if the I-th parameter of 'F' is a value or an rvalue reference, i.e. 'f' takes its argument over
+      */
+      template <typename F, std::size_t I>
+      constexpr bool takes_over() noexcept {
+         using params = typename parameters_of<F>::type;
+         if constexpr(std::is_void_v<params>)
+            return false;
+         else
+            return !std::is_lvalue_reference_v<std::tuple_element_t<I, params>>;
+      }
+
+      /**
+         A parameter by value receives the value of the input (moved if the consumer is its sole owner),
+         a parameter by reference binds to the value stored in the input, both without a copy where it is possible
+      */
+      template <typename F, std::size_t I, typename T>
+      decltype(auto) unwrap_argument(future<T>& ftr) {
+         if constexpr(takes_over<F, I>() || !std::is_copy_constructible_v<T>)
+            return ftr.consume();
+         else
+            return ftr.get();
+      }
+
+      template <typename F, std::size_t... I, typename... Ts>
+      auto invoke_unwrapped(const F& f, std::index_sequence<I...>, future<Ts>&... ftrs) {
+         return f(unwrap_argument<F, I>(ftrs)...);
+      }
+   }  // namespace detail
+
+   template <typename F>
+   auto future_unwrap(F f) noexcept {
+      return [f](auto... ftrs) {
+         return detail::invoke_unwrapped(f, std::index_sequence_for<decltype(ftrs)...>{}, ftrs...);
+      };
+   }
+
+   namespace detail
+   {
+      template <typename F>
+      auto async_adapter(F f, executor& ex, granularity gr, memo_cache* cache, tracer* tr, std::string name) {
+         auto g = std::make_shared<granularity>(std::move(gr));
+         return [f, &ex, g, cache, tr, name = std::move(name)](auto... afs) {
+            const auto key = cache? cache->intern(interior_key(f, key_of(afs)...)) : memo_key{};
+            node_trace trace{tr, tr? tr->add_node() : tracer::no_node, name, {}};
+            if(tr)
+               for(const auto input : {tracer::no_node, trace_id_of(afs)...})
+                  if(input!=tracer::no_node)
+                     trace.inputs.push_back(input);
+            const auto id = trace.id;
+            return make_node([f, &ex, g, cache, key, trace = std::move(trace), inputs = std::make_tuple(std::move(afs)...)](const cancellation_token& ct) mutable {
+               return memoized(cache, key, [&] {
+                  auto all = std::apply([&](auto&... afs) {
+                     // the inputs are launched once, so the node passes its handles over (see node::operator() &&)
+                     return when_all(launch_input(std::move(afs), ct)...);
+                  }, inputs);
+                  std::shared_ptr<tracer::clock::time_point> ready;
+                  if(trace.tr) {
+                     ready = std::make_shared<tracer::clock::time_point>();
+                     all.on_ready([ready] { *ready = tracer::clock::now(); });   // <-- runs before the continuation below, they run in the order of attachment
+                  }
+                  return std::move(all).then(ex, [f, g, ct, &ex, trace = std::move(trace), ready](auto all) {
+                     rethrow_input_error(all.get());
+                     return trace(ex, ready? *ready : tracer::clock::time_point{}, [&]() -> decltype(auto) {
+                        return run_cancellable(ct, [&]() -> decltype(auto) {
+                           return g->measure([&] { return std::apply(future_unwrap(f), all.consume()); });
+                        });
+                     });
+                  }, [&ex, g] { return g->run_inline(ex); }, [](const auto& all) { return numa_node_of_largest(all.get()); });
+               });
+            }, key, id);
+         };
+      }
+   }  // namespace detail
+
+   /**
+      \param afs...  argument list of nodes (or any callable objects without input arguments which return pdag::future<>) like asynchronize(f)(a1,a2,a3) mentioned above
+
+      Usage Example:
+         Let's suppose there are two asynchronous function objects
+            auto af1 = asynchronize(func1)(a1,a2,a3);
+            auto af2 = asynchronize(func2)(a1);
+         and function 'TR fun3(...)' that expects results from both of them
+         then the invocation below means
+
+         auto result = async_adapter(func3)(af1,af2)();
+              ^4                    ^1     ^2       ^3
+         where
+            ^1 - asynchronous version of 'func3' that mimics 'func3' accepting the same arguments
+            ^2 - another node that captures 'func3', 'af1', 'af2'
+            ^3 - a direct invocations of 'af1', 'af2' and then when_all(...).then(...)
+                 (only once, 'af1', 'af2' may be shared with other consumers as well)
+                 'af1()', 'af2()' produce future<> values, 'func3' becomes runnable only once all of them are ready,
+                 so no thread is parked waiting for upstream results. The ready values are passed to 'func3' by means future_unwrap
+                 'func3' is skipped if the cancellation_token passed to ^3 is cancelled by then (see cancellation.h)
+            ^4 - pdag::future<TR> object, the result of 'func3' can be obtained by calling method get().
+
+      \param ex  a pool of threads where 'f' is executed, default_executor() if it is not specified
+      \param gr  whether 'f' is cheap enough to run inline by the thread which finishes the last of 'afs...' (see granularity),
+                 the statistics is shared by all nodes produced by the same adapter
+      \param tr  if it is specified, every node records an event named 'name' into the latest run of 'tr' (see trace.h),
+                 the node becomes ready when the last of 'afs...' is ready
+   */
+
+   template <typename F>
+   auto async_adapter(F f, executor& ex = default_executor(), granularity gr = {}, tracer* tr = nullptr, std::string name = {}) {
+      return detail::async_adapter(std::move(f), ex, std::move(gr), nullptr, tr, std::move(name));
+   }
+
+   /**
+      The same as above but nodes are memoized in 'cache' keyed by 'f' and identities of 'afs...' (see memo.h).
+      A node found in the cache does not launch its inputs at all, so a rerun recomputes only the dirty subgraph.
+   */
+
+   template <typename F>
+   auto async_adapter(F f, memo_cache& cache, executor& ex = default_executor(), granularity gr = {}, tracer* tr = nullptr, std::string name = {}) {
+      static_assert(detail::has_identity_v<F>, "pdag::memo_cache: a stateful callable has no identity (see memo.h)");
+      return detail::async_adapter(std::move(f), ex, std::move(gr), &cache, tr, std::move(name));
+   }
+
+}  // namespace pdag
+
+#endif // _PDAG_H__
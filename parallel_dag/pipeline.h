@@ -0,0 +1,420 @@
+#if !defined(_PDAG_PIPELINE_H__)
+#define _PDAG_PIPELINE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+   Streaming (pipeline-parallel) mode.
+   A DAG run handles one item, a continuous stream of items pushed through the same stages is better served by a pipeline:
+   every stage is a persistent thread connected to the next one by a bounded lock-free single-producer/single-consumer queue,
+   so item N+1 is in stage 1 while item N is in stage 3. A full queue stalls its producer (back pressure),
+   so a slow stage bounds the memory of the whole pipeline.
+
+   Usage Example:
+      auto p = pipeline<string>{16}
+                  .stage(create,                                    "create")
+                  .stage([](string s) { return concat(s, s); },    "concat")
+                  .stage(twice,                                     "twice");
+
+      std::thread producer{[&] { for(auto w : words) p.push(w); p.close(); }};
+      while(auto r = p.pop())
+         cout << *r;
+      producer.join();
+      p.report(cout);    // throughput and latency of every stage
+
+   Note:
+      - push()/close() are called by one thread and pop() by one thread (it may be the same thread);
+      - a stage which throws stops the pipeline, push() and pop() rethrow its exception;
+      - the destructor stops the stages, items in flight are dropped.
+*/
+
+namespace pdag
+{
+   namespace detail
+   {
+      constexpr std::size_t cache_line = 64;
+
+      /**
+         A bounded wait-free single-producer/single-consumer ring.
+         Each side owns its index on a cache line of its own and caches the index of the other side,
+         so the shared line is touched only when the ring looks full (producer) or empty (consumer).
+      */
+      template <typename T>
+      class spsc_queue {
+         std::unique_ptr<std::optional<T>[]> slots_;
+         const std::size_t                   mask_;
+
+         alignas(cache_line) std::atomic<std::size_t> head_{0};   // next slot to pop, written by the consumer
+         std::size_t                                  cached_tail_{0};
+         alignas(cache_line) std::atomic<std::size_t> tail_{0};   // next slot to push, written by the producer
+         std::size_t                                  cached_head_{0};
+         alignas(cache_line) std::atomic<bool>        closed_{false};
+
+         static std::size_t round_up(std::size_t n) noexcept {
+            std::size_t r{1};
+            while(r<n)
+               r <<= 1;
+            return r;
+         }
+
+      public:
+         explicit spsc_queue(std::size_t capacity)
+            : slots_{std::make_unique<std::optional<T>[]>(round_up(std::max<std::size_t>(capacity, 1)))}
+            , mask_{round_up(std::max<std::size_t>(capacity, 1))-1} {}
+
+         /**
+            \return false if the ring is full, 'v' is left untouched then
+         */
+         bool try_push(T& v) {
+            const auto tail = tail_.load(std::memory_order_relaxed);
+            if(tail-cached_head_>mask_) {
+               cached_head_ = head_.load(std::memory_order_acquire);
+               if(tail-cached_head_>mask_)
+                  return false;
+            }
+            slots_[tail & mask_].emplace(std::move(v));
+            tail_.store(tail+1, std::memory_order_release);
+            return true;
+         }
+
+         std::optional<T> try_pop() {
+            const auto head = head_.load(std::memory_order_relaxed);
+            if(head==cached_tail_) {
+               cached_tail_ = tail_.load(std::memory_order_acquire);
+               if(head==cached_tail_)
+                  return std::nullopt;
+            }
+            auto& slot = slots_[head & mask_];
+            std::optional<T> v{std::move(slot)};
+            slot.reset();
+            head_.store(head+1, std::memory_order_release);
+            return v;
+         }
+
+         /**
+            The producer has pushed its last item
+         */
+         void close() noexcept {
+            closed_.store(true, std::memory_order_release);
+         }
+         bool closed() const noexcept {
+            return closed_.load(std::memory_order_acquire);
+         }
+      };
+
+      /**
+         Spins first, then yields and finally sleeps, so an idle stage does not burn a core
+      */
+      class backoff {
+         unsigned n_{0};
+      public:
+         void pause() {
+            if(n_<64)
+               ++n_;
+            if(n_<16)
+               return;
+            if(n_<64)
+               std::this_thread::yield();
+            else
+               std::this_thread::sleep_for(std::chrono::microseconds{50});
+         }
+      };
+
+      template <typename T>
+      struct envelope {
+         using clock = std::chrono::steady_clock;
+         T                    value;
+         clock::time_point    entered;   // when the item was pushed into the queue of the stage
+      };
+
+      /**
+         Written by the stage thread only, read by anyone
+      */
+      struct stage_counters {
+         using rep_t = std::chrono::nanoseconds::rep;
+
+         std::string          name;
+         std::atomic<std::size_t> items{0};
+         std::atomic<rep_t>   busy{0};
+         std::atomic<rep_t>   total_latency{0};
+         std::atomic<rep_t>   max_latency{0};
+         std::atomic<rep_t>   first_start{-1};   // since the epoch of steady_clock
+         std::atomic<rep_t>   last_end{0};
+
+         explicit stage_counters(std::string name) : name(std::move(name)) {}
+      };
+
+      class pipeline_core {
+         std::mutex                   m_;
+         std::exception_ptr           error_;
+         std::atomic<bool>            stopped_{false};
+         std::deque<stage_counters>   counters_;   // <-- stable addresses
+         std::vector<std::thread>     threads_;
+
+      public:
+         const std::size_t            capacity;
+
+         explicit pipeline_core(std::size_t capacity) noexcept : capacity(capacity) {}
+         ~pipeline_core() {
+            stop();
+            for(auto& t : threads_)
+               t.join();
+         }
+
+         stage_counters& add_stage(std::string name) {
+            std::lock_guard<std::mutex> l{m_};
+            return counters_.emplace_back(std::move(name));
+         }
+         template <typename F>
+         void start(F&& f) {
+            std::lock_guard<std::mutex> l{m_};
+            threads_.emplace_back(std::forward<F>(f));
+         }
+
+         void fail(std::exception_ptr e) {
+            {
+               std::lock_guard<std::mutex> l{m_};
+               if(!error_)
+                  error_ = std::move(e);
+            }
+            stop();
+         }
+         void stop() noexcept {
+            stopped_.store(true, std::memory_order_release);
+         }
+         bool stopped() const noexcept {
+            return stopped_.load(std::memory_order_acquire);
+         }
+         void rethrow_if_failed() {
+            std::lock_guard<std::mutex> l{m_};
+            if(error_)
+               std::rethrow_exception(error_);
+         }
+
+         template <typename Visitor>
+         void for_each_stage(Visitor&& v) {
+            std::lock_guard<std::mutex> l{m_};
+            for(const auto& c : counters_)
+               v(c);
+         }
+      };
+
+      /**
+         Pushes 'e' stamping the time it enters the queue, waits while the queue is full
+         \return false if the pipeline has been stopped meanwhile
+      */
+      template <typename T>
+      bool push(spsc_queue<envelope<T>>& q, envelope<T>& e, const pipeline_core& core) {
+         backoff b;
+         e.entered = envelope<T>::clock::now();
+         while(!q.try_push(e)) {
+            if(core.stopped())
+               return false;
+            b.pause();
+         }
+         return true;
+      }
+
+      /**
+         Waits for the next item, nothing if the queue is closed and drained or the pipeline has been stopped
+      */
+      template <typename T>
+      std::optional<envelope<T>> pop(spsc_queue<envelope<T>>& q, const pipeline_core& core) {
+         backoff b;
+         for(;;) {
+            if(auto e = q.try_pop())
+               return e;
+            if(core.stopped())
+               return std::nullopt;
+            if(q.closed())
+               return q.try_pop();   // <-- the last items may have been pushed right before close()
+            b.pause();
+         }
+      }
+   }  // namespace detail
+
+   /**
+      Snapshot of the counters of a stage
+   */
+   struct stage_stats {
+      std::string                name;
+      std::size_t                items;
+      std::chrono::nanoseconds   busy;          // time spent in the stage function
+      std::chrono::nanoseconds   elapsed;       // from the start of the first item to the end of the last one
+      std::chrono::nanoseconds   avg_latency;   // from entering the input queue of the stage to leaving the stage
+      std::chrono::nanoseconds   max_latency;
+
+      /**
+         \return items per second
+      */
+      double throughput() const noexcept {
+         return elapsed.count()>0? items * 1e9 / elapsed.count() : 0.;
+      }
+      /**
+         \return the fraction of time the stage was busy, the bottleneck of a pipeline is close to 1
+      */
+      double utilization() const noexcept {
+         return elapsed.count()>0? static_cast<double>(busy.count()) / elapsed.count() : 0.;
+      }
+   };
+
+   template <typename In, typename Out = In>
+   class pipeline {
+      template <typename, typename> friend class pipeline;
+
+      std::shared_ptr<detail::pipeline_core>                        core_;
+      std::shared_ptr<detail::spsc_queue<detail::envelope<In>>>    in_;
+      std::shared_ptr<detail::spsc_queue<detail::envelope<Out>>>    out_;
+
+      pipeline(std::shared_ptr<detail::pipeline_core> core,
+               std::shared_ptr<detail::spsc_queue<detail::envelope<In>>> in,
+               std::shared_ptr<detail::spsc_queue<detail::envelope<Out>>> out) noexcept
+         : core_(std::move(core)), in_(std::move(in)), out_(std::move(out)) {}
+
+   public:
+      /**
+         An empty pipeline, stages are added by stage(...)
+         \param capacity  of every queue between stages
+      */
+      explicit pipeline(std::size_t capacity = 64)
+         : core_{std::make_shared<detail::pipeline_core>(capacity)}
+         , in_{std::make_shared<detail::spsc_queue<detail::envelope<In>>>(capacity)} {
+         static_assert(std::is_same_v<In, Out>, "pdag::pipeline: an empty pipeline passes its items through");
+         if constexpr(std::is_same_v<In, Out>)
+            out_ = in_;
+      }
+
+      pipeline(pipeline&&) noexcept = default;
+      pipeline& operator=(pipeline&&) noexcept = default;
+
+      /**
+         Appends a stage 'f(Out)' running on a thread of its own
+         \return the pipeline which produces results of 'f'
+      */
+      template <typename F>
+      auto stage(F f, std::string name = {}) && {
+         using R = std::decay_t<std::invoke_result_t<F&, Out&&>>;
+         auto  next     = std::make_shared<detail::spsc_queue<detail::envelope<R>>>(core_->capacity);
+         auto& counters = core_->add_stage(name.empty()? "stage " + std::to_string(stage_count()+1) : std::move(name));
+         core_->start([f = std::move(f), in = out_, out = next, core = core_.get(), &counters]() mutable {
+            using clock = std::chrono::steady_clock;
+            using ns    = std::chrono::nanoseconds;
+            while(auto e = detail::pop(*in, *core)) {
+               const auto start = clock::now();
+               std::optional<detail::envelope<R>> r;
+               try {
+                  r.emplace(detail::envelope<R>{f(std::move(e->value)), {}});
+               }
+               catch(...) {
+                  core->fail(std::current_exception());
+                  break;
+               }
+               const auto end = clock::now();
+               const auto latency = std::chrono::duration_cast<ns>(end-e->entered).count();
+               counters.busy.fetch_add(std::chrono::duration_cast<ns>(end-start).count(), std::memory_order_relaxed);
+               counters.total_latency.fetch_add(latency, std::memory_order_relaxed);
+               counters.max_latency.store(std::max(counters.max_latency.load(std::memory_order_relaxed), latency), std::memory_order_relaxed);
+               if(counters.first_start.load(std::memory_order_relaxed)<0)
+                  counters.first_start.store(std::chrono::duration_cast<ns>(start.time_since_epoch()).count(), std::memory_order_relaxed);
+               counters.last_end.store(std::chrono::duration_cast<ns>(end.time_since_epoch()).count(), std::memory_order_relaxed);
+               counters.items.fetch_add(1, std::memory_order_release);
+               if(!detail::push(*out, *r, *core))
+                  break;
+            }
+            out->close();
+         });
+         return pipeline<In, R>{std::move(core_), std::move(in_), std::move(next)};
+      }
+
+      /**
+         Feeds the first stage, waits while its queue is full.
+         Rethrows the exception of a failed stage.
+      */
+      void push(In v) {
+         detail::envelope<In> e{std::move(v), {}};
+         if(!detail::push(*in_, e, *core_)) {
+            core_->rethrow_if_failed();
+            throw std::logic_error{"pdag::pipeline: the pipeline is stopped"};
+         }
+      }
+
+      /**
+         The end of the stream, pop() returns nothing once all items in flight are out
+      */
+      void close() noexcept {
+         in_->close();
+      }
+
+      /**
+         Waits for the next result.
+         \return nothing at the end of the stream, rethrows the exception of a failed stage
+      */
+      std::optional<Out> pop() {
+         if(auto e = detail::pop(*out_, *core_))
+            return std::move(e->value);
+         core_->rethrow_if_failed();
+         return std::nullopt;
+      }
+
+      std::size_t stage_count() const {
+         std::size_t n{0};
+         core_->for_each_stage([&n](const auto&) { ++n; });
+         return n;
+      }
+
+      std::vector<stage_stats> stats() const {
+         using ns = std::chrono::nanoseconds;
+         std::vector<stage_stats> r;
+         core_->for_each_stage([&r](const detail::stage_counters& c) {
+            const auto items = c.items.load(std::memory_order_acquire);
+            const auto first = c.first_start.load(std::memory_order_relaxed);
+            r.push_back({c.name, items,
+                         ns{c.busy.load(std::memory_order_relaxed)},
+                         ns{first<0? 0 : c.last_end.load(std::memory_order_relaxed)-first},
+                         ns{items? c.total_latency.load(std::memory_order_relaxed)/static_cast<ns::rep>(items) : 0},
+                         ns{c.max_latency.load(std::memory_order_relaxed)}});
+         });
+         return r;
+      }
+
+      /**
+         Prints throughput, utilization and latency of every stage
+      */
+      void report(std::ostream& os) const {
+         const auto ms = [](std::chrono::nanoseconds d) {
+            return std::chrono::duration<double, std::milli>(d).count();
+         };
+         const auto flags     = os.flags();
+         const auto precision = os.precision(1);
+         os << std::fixed << "*** pipeline stages:\n";
+         for(const auto& s : stats())
+            os << "   " << std::left << std::setw(16) << s.name << std::right
+               << " items " << std::setw(8) << s.items
+               << "   " << std::setw(10) << s.throughput() << " items/s"
+               << "   busy " << std::setw(5) << 100.*s.utilization() << "%"
+               << "   latency avg " << std::setw(10) << ms(s.avg_latency) << " ms"
+               << ", max " << std::setw(10) << ms(s.max_latency) << " ms\n";
+         os.flags(flags);
+         os.precision(precision);
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_PIPELINE_H__
@@ -0,0 +1,246 @@
+#if !defined(_PDAG_STATIC_GRAPH_H__)
+#define _PDAG_STATIC_GRAPH_H__
+
+#include "executor.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+   A DAG whose shape is known at compile time.
+   Nodes are types: snode<F, Deps...> is 'F(result of Deps...)', a dependency is an index of a preceding node,
+   so the graph is acyclic by construction. Topological levels are computed by constexpr functions and the schedule
+   is unrolled by the compiler:
+      - a level of a single node (e.g. a chain) is a plain function call on the calling thread,
+      - a wider level is a fork-join: all nodes but one are submitted to the pool, the last one runs inline.
+   There are no futures, no type erasure and no allocations: results live in a tuple on the stack of run(),
+   inputs are passed to 'F' by reference and jobs are small enough for the inline buffer of executor jobs.
+
+   Usage Example:
+      string foo()  { return create("foo "); }
+      string bar()  { return create("bar "); }
+
+      using dag = static_graph<
+         snode<foo>,                // 0
+         snode<bar>,                // 1
+         snode<concat, 0, 1>,       // 2
+         snode<twice, 2>            // 3
+      >;
+      static_assert(dag::depth()==3);
+
+      auto res = std::get<3>(dag::run(pool));
+
+   Note:
+      - 'F' is a function (or a pointer to it), a node returns a non-void value;
+      - if a node throws, the level is joined, the rest of the graph is skipped and run() rethrows the first exception.
+*/
+
+namespace pdag
+{
+   template <auto F, std::size_t... Deps>
+   struct snode {
+      static constexpr auto                                   function = F;
+      static constexpr std::array<std::size_t, sizeof...(Deps)> deps{{Deps...}};
+
+      /**
+         The result type of the node given results of preceding nodes
+      */
+      template <typename Results>
+      struct result {
+         static_assert(((Deps<std::tuple_size_v<Results>) && ...), "pdag::static_graph: a node may depend on preceding nodes only");
+         using type = std::decay_t<std::invoke_result_t<decltype(F), const std::tuple_element_t<Deps, Results>&...>>;
+         static_assert(!std::is_void_v<type>, "pdag::static_graph: a node must return a value");
+      };
+
+      template <typename Storage>
+      static auto invoke(const Storage& s) {
+         return std::invoke(F, *std::get<Deps>(s)...);
+      }
+   };
+
+   namespace detail
+   {
+      template <typename Done, typename... Nodes>
+      struct results_of;
+
+      template <typename... R>
+      struct results_of<std::tuple<R...>> {
+         using type = std::tuple<R...>;
+      };
+
+      template <typename... R, typename N, typename... Rest>
+      struct results_of<std::tuple<R...>, N, Rest...>
+         : results_of<std::tuple<R..., typename N::template result<std::tuple<R...>>::type>, Rest...> {};
+
+      template <typename Tuple>
+      struct optionals_of;
+
+      template <typename... R>
+      struct optionals_of<std::tuple<R...>> {
+         using type = std::tuple<std::optional<R>...>;
+      };
+
+      /**
+         Join of a fork-join level, it lives on the stack of static_graph::run
+      */
+      struct fork_t {
+         std::atomic<std::size_t>   left;
+         std::mutex                 m;
+         std::exception_ptr         error;
+
+         explicit fork_t(std::size_t n) noexcept : left(n) {}
+
+         void fail(std::exception_ptr e) {
+            std::lock_guard<std::mutex> l{m};
+            if(!error)
+               error = std::move(e);
+         }
+
+         /**
+            The calling thread helps the pool until the submitted nodes are done
+         */
+         void join(executor& ex) {
+            while(left.load(std::memory_order_acquire)>0)
+               if(!ex.run_pending_task())
+                  std::this_thread::yield();
+         }
+      };
+   }  // namespace detail
+
+   template <typename... Nodes>
+   class static_graph {
+   public:
+      using results_type = typename detail::results_of<std::tuple<>, Nodes...>::type;
+
+   private:
+      using storage_t = typename detail::optionals_of<results_type>::type;
+
+      static constexpr std::size_t count = sizeof...(Nodes);
+
+      static constexpr std::array<std::size_t, count> compute_levels() {
+         std::array<std::size_t, count> levels{};
+         std::size_t i{0};
+         ((levels[i++] = [&levels] {
+            std::size_t l{0};
+            for(const auto d : Nodes::deps)
+               l = std::max(l, levels[d]+1);
+            return l;
+         }()), ...);
+         return levels;
+      }
+
+      static constexpr std::array<std::size_t, count> levels_ = compute_levels();
+
+      static constexpr std::size_t width(std::size_t level) {
+         std::size_t n{0};
+         for(const auto l : levels_)
+            n += l==level;
+         return n;
+      }
+
+      static constexpr std::size_t last_of(std::size_t level) {
+         std::size_t last{0};
+         for(std::size_t i{0}; i<count; ++i)
+            if(levels_[i]==level)
+               last = i;
+         return last;
+      }
+
+      template <std::size_t I>
+      static void run_node(storage_t& s) {
+         using node = std::tuple_element_t<I, std::tuple<Nodes...>>;
+         std::get<I>(s).emplace(node::invoke(s));
+      }
+
+      template <std::size_t L, std::size_t I>
+      static void run_if_at(storage_t& s) {
+         if constexpr(levels_[I]==L)
+            run_node<I>(s);
+      }
+
+      template <std::size_t L, std::size_t I>
+      static void schedule(executor& ex, storage_t& s, detail::fork_t& f) {
+         if constexpr(levels_[I]==L) {
+            if constexpr(I==last_of(L)) {
+               try {
+                  run_node<I>(s);
+               }
+               catch(...) {
+                  f.fail(std::current_exception());
+               }
+            }
+            else
+               ex.submit([&s, &f] {
+                  try {
+                     run_node<I>(s);
+                  }
+                  catch(...) {
+                     f.fail(std::current_exception());
+                  }
+                  f.left.fetch_sub(1, std::memory_order_release);
+               });
+         }
+      }
+
+      template <std::size_t L, std::size_t... I>
+      static void run_level(executor& ex, storage_t& s, std::index_sequence<I...>) {
+         if constexpr(width(L)==1)
+            (run_if_at<L, I>(s), ...);
+         else {
+            detail::fork_t f{width(L)-1};
+            (schedule<L, I>(ex, s, f), ...);
+            f.join(ex);
+            if(f.error)
+               std::rethrow_exception(f.error);
+         }
+      }
+
+      template <std::size_t... L>
+      static void run_levels(executor& ex, storage_t& s, std::index_sequence<L...>) {
+         (run_level<L>(ex, s, std::index_sequence_for<Nodes...>{}), ...);
+      }
+
+   public:
+      static constexpr std::size_t size() noexcept {
+         return count;
+      }
+      /**
+         \return the number of levels, i.e. the length of the longest chain
+      */
+      static constexpr std::size_t depth() noexcept {
+         std::size_t d{0};
+         for(const auto l : levels_)
+            d = std::max(d, l+1);
+         return d;
+      }
+      /**
+         \return the topological level of node 'i', 0 for a node without dependencies
+      */
+      static constexpr std::size_t level(std::size_t i) {
+         return levels_[i];
+      }
+
+      /**
+         Runs the graph level by level, the calling thread takes part in the work.
+         \return results of all nodes
+      */
+      static results_type run(executor& ex = default_executor()) {
+         storage_t s;
+         run_levels(ex, s, std::make_index_sequence<depth()>{});
+         return std::apply([](auto&... r) { return results_type{std::move(*r)...}; }, s);
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_STATIC_GRAPH_H__
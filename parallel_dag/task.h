@@ -0,0 +1,177 @@
+#if !defined(_PDAG_TASK_H__)
+#define _PDAG_TASK_H__
+
+#include "executor.h"
+#include "future.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "pdag/task.h requires C++20 coroutines, e.g. g++ -std=c++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+/**
+   DAG stages written as coroutines which co_await their inputs:
+
+      task<string> pcreate(executor&, string_view s)                 { co_return create(s); }
+      task<string> pconcat(executor&, task<string> a, task<string> b) { co_return concat(co_await a, co_await b); }
+
+      auto res = pconcat(pool, pcreate(pool, "foo "), pcreate(pool, "bar ")).get();
+
+   A task is eager: it is scheduled on the pool as soon as it is created, hence all inputs run concurrently
+   although they are awaited one after another. A suspended stage holds no thread at all, it is just a coroutine frame
+   which is resumed on the pool when the awaited result is published. Thus tens of thousands of in-flight stages
+   can be kept on a small pool.
+
+   The pool is the first argument of the coroutine if it is 'executor&',
+   otherwise the pool of the calling worker or default_executor().
+
+   \see https://lewissbaker.github.io/2017/11/17/understanding-operator-co-await
+*/
+
+namespace pdag
+{
+   template <typename T> class task;
+
+   namespace detail
+   {
+      inline executor& current_or_default_executor() noexcept {
+         auto* ex = executor::current();
+         return ex? *ex : default_executor();
+      }
+
+      /**
+         Suspends the coroutine until 'ftr' becomes ready and then resumes it on 'ex'
+      */
+      template <typename T>
+      struct future_awaiter {
+         future<T>   ftr;
+         executor&   ex;
+
+         bool await_ready() const {
+            return ftr.is_ready();
+         }
+         void await_suspend(std::coroutine_handle<> h) const {
+            auto keep = ftr;   // <-- the awaiter itself may be gone as soon as the coroutine is resumed by other thread
+            keep.on_ready([h, &ex = ex] {
+               ex.submit([h] { h.resume(); });
+            });
+         }
+         /**
+            the value is moved out if the awaiter is its sole owner, e.g. co_await of a future returned by a node
+         */
+         T await_resume() {
+            return ftr.consume();
+         }
+      };
+
+      template <typename T>
+      struct promise_base {
+         executor&            ex;
+         pdag::promise<T>     p;
+
+         explicit promise_base(executor& ex) noexcept : ex(ex) {}
+
+         template <typename U>
+         void return_value(U&& v) {
+            p.set_value(std::forward<U>(v));
+         }
+      };
+
+      template <>
+      struct promise_base<void> {
+         executor&            ex;
+         pdag::promise<void>  p;
+
+         explicit promise_base(executor& ex) noexcept : ex(ex) {}
+
+         void return_void() {
+            p.set_value();
+         }
+      };
+   }  // namespace detail
+
+   /**
+      An eager coroutine whose result is a pdag::future<T>.
+      It can be co_awaited (by value) any number of times, converted to a future or waited for by an external consumer.
+   */
+
+   template <typename T>
+   class task {
+      future<T> ftr_;
+
+   public:
+      struct promise_type : detail::promise_base<T> {
+         promise_type() noexcept
+            : detail::promise_base<T>(detail::current_or_default_executor()) {}
+
+         template <typename... Args>
+         promise_type(executor& ex, Args&&...) noexcept
+            : detail::promise_base<T>(ex) {}
+
+         task get_return_object() {
+            return task{this->p.get_future()};
+         }
+
+         /**
+            the body of the coroutine starts on the pool, not on the thread which has created the task
+         */
+         auto initial_suspend() noexcept {
+            struct schedule_t {
+               executor& ex;
+               bool await_ready() const noexcept { return false; }
+               void await_suspend(std::coroutine_handle<> h) const {
+                  ex.submit([h] { h.resume(); });
+               }
+               void await_resume() const noexcept {}
+            };
+            return schedule_t{this->ex};
+         }
+
+         /**
+            the result has been already published by co_return, the frame destroys itself
+         */
+         std::suspend_never final_suspend() noexcept {
+            return {};
+         }
+
+         void unhandled_exception() {
+            this->p.set_exception(std::current_exception());
+         }
+
+         /**
+            co_await inside of a task resumes the awaiting coroutine on its own pool
+         */
+         template <typename U>
+         detail::future_awaiter<U> await_transform(future<U> ftr) {
+            return {std::move(ftr), this->ex};
+         }
+         template <typename U>
+         detail::future_awaiter<U> await_transform(const task<U>& t) {
+            return {t.as_future(), this->ex};
+         }
+      };
+
+      explicit task(future<T> ftr) noexcept : ftr_(std::move(ftr)) {}
+
+      future<T> as_future() const noexcept {
+         return ftr_;
+      }
+      bool is_ready() const {
+         return ftr_.is_ready();
+      }
+
+      /**
+         Blocks until the coroutine completes. Within a coroutine use co_await instead.
+      */
+      decltype(auto) get() const {
+         return ftr_.get();
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_TASK_H__
@@ -0,0 +1,159 @@
+#if !defined(_PDAG_TOPOLOGY_H__)
+#define _PDAG_TOPOLOGY_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace pdag
+{
+   /**
+      CPUs of the host grouped by NUMA node.
+      On Linux it is read from /sys/devices/system/node/node<N>/cpulist and restricted to CPUs the process may run on
+      (sched_getaffinity, e.g. inside a container). Elsewhere, or if /sys is not available, the host is a single node
+      of std::thread::hardware_concurrency() CPUs.
+
+      Usage Example:
+         executor pool{16, cpu_topology::detect()};   // workers pinned to cores, spread evenly over NUMA nodes
+   */
+
+   class cpu_topology {
+      std::vector<std::vector<unsigned>> nodes_;   // CPUs of every NUMA node, nodes without allowed CPUs are dropped
+      std::vector<int>                   node_ids_;  // system id of every node
+
+      /**
+         Parses a list like "0-3,8-11"
+      */
+      static std::vector<unsigned> parse_cpulist(const std::string& s) {
+         std::vector<unsigned> cpus;
+         std::istringstream in{s};
+         for(std::string range; std::getline(in, range, ',');) {
+            const auto dash = range.find('-');
+            try {
+               const auto first = std::stoul(range.substr(0, dash));
+               const auto last  = dash==std::string::npos? first : std::stoul(range.substr(dash+1));
+               for(auto c = first; c<=last; ++c)
+                  cpus.push_back(static_cast<unsigned>(c));
+            }
+            catch(const std::exception&) {
+               // <-- an empty or malformed entry is skipped
+            }
+         }
+         return cpus;
+      }
+
+      static bool allowed(unsigned cpu) noexcept {
+#if defined(__linux__)
+         static const cpu_set_t set = [] {
+            cpu_set_t s;
+            CPU_ZERO(&s);
+            if(sched_getaffinity(0, sizeof(s), &s)!=0)
+               for(unsigned c{0}; c<CPU_SETSIZE; ++c)
+                  CPU_SET(c, &s);
+            return s;
+         }();
+         return cpu<CPU_SETSIZE && CPU_ISSET(cpu, &set);
+#else
+         (void)cpu;
+         return true;
+#endif
+      }
+
+   public:
+      /**
+         A single node of 'cpus' CPUs
+      */
+      static cpu_topology uniform(std::size_t cpus = std::thread::hardware_concurrency()) {
+         cpu_topology t;
+         t.nodes_.emplace_back();
+         for(unsigned c{0}; c<std::max<std::size_t>(cpus, 1); ++c)
+            t.nodes_.back().push_back(c);
+         t.node_ids_.push_back(0);
+         return t;
+      }
+
+      static cpu_topology detect() {
+         cpu_topology t;
+#if defined(__linux__)
+         for(int n{0}; n<1024; ++n) {
+            std::ifstream f{"/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"};
+            if(!f) {
+               if(n>0 && !t.node_ids_.empty())
+                  break;   // <-- node ids are dense in practice, the first gap ends the list
+               continue;
+            }
+            std::string line;
+            std::getline(f, line);
+            auto cpus = parse_cpulist(line);
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [](unsigned c) { return !allowed(c); }), cpus.end());
+            if(cpus.empty())
+               continue;
+            t.nodes_.push_back(std::move(cpus));
+            t.node_ids_.push_back(n);
+         }
+         if(t.nodes_.empty()) {
+            t = uniform();
+            auto& cpus = t.nodes_.front();
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [](unsigned c) { return !allowed(c); }), cpus.end());
+            if(cpus.empty())
+               t = uniform();
+         }
+#else
+         t = uniform();
+#endif
+         return t;
+      }
+
+      std::size_t nodes() const noexcept {
+         return nodes_.size();
+      }
+      /**
+         \return CPUs of the i-th node (0 <= i < nodes())
+      */
+      const std::vector<unsigned>& cpus(std::size_t i) const {
+         return nodes_.at(i);
+      }
+      /**
+         \return the system id of the i-th node, i.e. N of /sys/devices/system/node/nodeN
+      */
+      int node_id(std::size_t i) const {
+         return node_ids_.at(i);
+      }
+      std::size_t cpu_count() const noexcept {
+         std::size_t n{0};
+         for(const auto& cpus : nodes_)
+            n += cpus.size();
+         return n;
+      }
+
+      /**
+         Pins the calling thread to 'cpu'
+         \return false if it is not supported or it has failed, the thread keeps running unpinned then
+      */
+      static bool pin_current_thread(unsigned cpu) noexcept {
+#if defined(__linux__)
+         if(cpu>=CPU_SETSIZE)
+            return false;
+         cpu_set_t s;
+         CPU_ZERO(&s);
+         CPU_SET(cpu, &s);
+         return pthread_setaffinity_np(pthread_self(), sizeof(s), &s)==0;
+#else
+         (void)cpu;
+         return false;
+#endif
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_TOPOLOGY_H__
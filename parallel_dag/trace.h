@@ -0,0 +1,265 @@
+#if !defined(_PDAG_TRACE_H__)
+#define _PDAG_TRACE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pdag
+{
+   /**
+      Per-node instrumentation of a DAG run: when a node became ready, when it started and finished and on which worker.
+      Nodes of graph::run and nodes made by asynchronize/async_adapter (pdag.h) given a tracer are recorded.
+      The collected events can be
+         - exported as Chrome trace_event JSON (open it in chrome://tracing or https://ui.perfetto.dev),
+         - summarized as the critical path of the run, i.e. the chain of nodes each of which was released by its predecessor.
+      A tracer may be reused by several runs: events are keyed by (run, node), all runs are exported (a process row per run)
+      and the latest run is summarized. graph::run begins a run of its own, nodes of asynchronize/async_adapter record
+      into the latest run (begin_run() separates evaluations of such DAGs).
+
+      Usage Example:
+         tracer tr;
+         g.run(pool, &tr).get();
+         tr.export_chrome(std::ofstream{"trace.json"});
+         tr.report_critical_path(std::cout);
+
+         auto pcreate = asynchronize(create, pool, &tr, "create");
+         auto pconcat = async_adapter(concat, pool, {}, &tr, "concat");
+         tr.begin_run(pool.size());
+         pconcat(pcreate("foo "), pcreate("bar "))().get();
+         tr.report_critical_path(std::cout);
+
+      \see https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+   */
+
+   class tracer {
+   public:
+      using clock = std::chrono::steady_clock;
+
+      struct event {
+         std::size_t                run;     // see begin_run()
+         std::size_t                node;
+         std::string                name;
+         std::vector<std::size_t>   inputs;
+         clock::time_point          ready;   // all inputs are available
+         clock::time_point          start;
+         clock::time_point          end;
+         long                       worker;  // index of the worker in its pool, -1 for a thread out of the pool
+
+         clock::duration wait() const noexcept {
+            return start-ready;
+         }
+         clock::duration duration() const noexcept {
+            return end-start;
+         }
+      };
+
+   private:
+      mutable std::mutex         m_;
+      std::vector<event>         events_;
+      std::vector<std::size_t>   runs_;   // number of workers of the pool of every run
+      clock::time_point          epoch_{clock::now()};
+      std::atomic<std::size_t>   next_node_{0};   // ids of nodes of asynchronize/async_adapter
+
+      static double us(clock::duration d) noexcept {
+         return std::chrono::duration<double, std::micro>(d).count();
+      }
+
+      static std::string escape(const std::string& s) {
+         std::string out;
+         for(const char c : s) {
+            if(c=='"' || c=='\\')
+               out += '\\';
+            if(static_cast<unsigned char>(c)<0x20)
+               continue;
+            out += c;
+         }
+         return out;
+      }
+
+      /**
+         \return events of the latest run
+      */
+      std::vector<event> last_run() const {
+         std::vector<event> last;
+         if(events_.empty())
+            return last;
+         const auto run = std::max_element(events_.begin(), events_.end(), [](const event& a, const event& b) { return a.run<b.run; })->run;
+         std::copy_if(events_.begin(), events_.end(), std::back_inserter(last), [run](const event& e) { return e.run==run; });
+         return last;
+      }
+
+   public:
+      /**
+         Starts a new run on a pool of 'workers' threads
+         \return the index of the run to be recorded into its events
+      */
+      std::size_t begin_run(std::size_t workers) {
+         std::lock_guard<std::mutex> l{m_};
+         runs_.push_back(workers);
+         return runs_.size()-1;
+      }
+
+      /**
+         \return the index of the latest run, a new run on a pool of 'workers' threads if there is none yet
+      */
+      std::size_t current_run(std::size_t workers) {
+         std::lock_guard<std::mutex> l{m_};
+         if(runs_.empty())
+            runs_.push_back(workers);
+         return runs_.size()-1;
+      }
+
+      static constexpr std::size_t no_node = static_cast<std::size_t>(-1);
+
+      /**
+         \return a new id of a node of asynchronize/async_adapter, ids are unique for the lifetime of the tracer
+      */
+      std::size_t add_node() noexcept {
+         return next_node_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void record(event e) {
+         std::lock_guard<std::mutex> l{m_};
+         events_.push_back(std::move(e));
+      }
+
+      std::vector<event> events() const {
+         std::lock_guard<std::mutex> l{m_};
+         return events_;
+      }
+
+      void clear() {
+         std::lock_guard<std::mutex> l{m_};
+         events_.clear();
+         runs_.clear();
+         epoch_ = clock::now();
+      }
+
+      /**
+         Writes events in Chrome trace_event format: one complete ("X") event per node, a row per worker
+      */
+      void export_chrome(std::ostream& os) const {
+         std::lock_guard<std::mutex> l{m_};
+         const auto flags     = os.flags();
+         const auto precision = os.precision(3);
+         os << std::fixed << "{\"traceEvents\":[";
+         const char* sep = "\n";
+         for(const auto& e : events_) {
+            os << sep << "{\"name\":\"" << escape(e.name.empty()? std::to_string(e.node) : e.name) << "\""
+               << ",\"cat\":\"pdag\",\"ph\":\"X\",\"pid\":" << e.run+1
+               << ",\"tid\":" << e.worker
+               << ",\"ts\":"  << us(e.start-epoch_)
+               << ",\"dur\":" << us(e.duration())
+               << ",\"args\":{\"node\":" << e.node << ",\"wait_us\":" << us(e.wait()) << "}}";
+            sep = ",\n";
+         }
+         os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+         os.flags(flags);
+         os.precision(precision);
+      }
+
+      void export_chrome(std::ostream&& os) const {
+         export_chrome(os);
+      }
+
+      /**
+         \return the chain of events of the latest run ending with the node which finished last,
+                 each previous one is the input which finished last, i.e. the one which actually released its successor
+      */
+      std::vector<event> critical_path() const {
+         std::lock_guard<std::mutex> l{m_};
+         const auto run = last_run();
+         std::map<std::size_t, const event*> by_node;
+         for(const auto& e : run)
+            by_node[e.node] = &e;
+         std::vector<event> path;
+         const event* cur{nullptr};
+         for(const auto& e : run)
+            if(!cur || e.end>cur->end)
+               cur = &e;
+         std::set<std::size_t> visited;
+         while(cur && visited.insert(cur->node).second) {
+            path.push_back(*cur);
+            const event* prev{nullptr};
+            for(auto i : cur->inputs) {
+               auto it = by_node.find(i);
+               if(it!=by_node.end() && (!prev || it->second->end>prev->end))
+                  prev = it->second;
+            }
+            cur = prev;
+         }
+         std::reverse(path.begin(), path.end());
+         return path;
+      }
+
+      /**
+         Prints the critical path with execution and wait time of every node on it,
+         the makespan of the latest run and how busy the workers of its pool were
+         (idle workers included, a node run inline by a thread out of the pool counts as work but not as utilization)
+      */
+      void report_critical_path(std::ostream& os) const {
+         const auto path = critical_path();
+         std::vector<event> all;
+         std::size_t pool_size{0};
+         {
+            std::lock_guard<std::mutex> l{m_};
+            all = last_run();
+            if(!all.empty() && all.front().run<runs_.size())
+               pool_size = runs_[all.front().run];
+         }
+         if(all.empty()) {
+            os << "*** no events\n";
+            return;
+         }
+         auto first = all.front().ready;
+         auto last  = all.front().end;
+         clock::duration busy{0}, pool_busy{0};
+         std::set<long> workers;   // of the pool, a node run inline by a thread out of the pool is not counted
+         for(const auto& e : all) {
+            first = std::min(first, e.ready);
+            last  = std::max(last, e.end);
+            busy += e.duration();
+            if(e.worker>=0) {
+               pool_busy += e.duration();
+               workers.insert(e.worker);
+            }
+         }
+         const auto flags     = os.flags();
+         const auto precision = os.precision(1);
+         clock::duration path_busy{0}, path_wait{0};
+         os << std::fixed << "*** critical path (" << path.size() << " of " << all.size() << " nodes):\n";
+         for(const auto& e : path) {
+            os << "   " << std::left << std::setw(16) << (e.name.empty()? std::to_string(e.node) : e.name) << std::right
+               << " worker " << std::setw(3) << e.worker
+               << "   run " << std::setw(12) << us(e.duration()) << " us"
+               << "   wait " << std::setw(10) << us(e.wait()) << " us\n";
+            path_busy += e.duration();
+            path_wait += e.wait();
+         }
+         if(pool_size==0)
+            pool_size = workers.size();   // <-- events recorded without begin_run(), only the workers seen are known
+         const auto makespan = last-first;
+         os << "*** makespan: " << us(makespan) << " us"
+            << ", on critical path: run " << us(path_busy) << " us, wait " << us(path_wait) << " us\n"
+            << "*** total work: " << us(busy) << " us on " << workers.size() << " of " << pool_size << " worker(s)"
+            << ", utilization " << std::setprecision(0)
+            << (makespan.count()>0 && pool_size>0? 100. * us(pool_busy) / (us(makespan) * pool_size) : 0.) << "%\n";
+         os.flags(flags);
+         os.precision(precision);
+      }
+   };
+
+}  // namespace pdag
+
+#endif // _PDAG_TRACE_H__
@@ -0,0 +1,164 @@
+/*
+   g++ benchmark.cpp -std=c++17 -O2 -Wextra -Wall -pedantic-errors -pthread -o benchmark
+
+   ./benchmark [--workers N] [--threads N] [--rounds N]
+*/
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+/**
+   Callbacks per second of worker::async_update(): 'workers' workers post their weak_from_this() guarded callback at once
+   and the time runs until the last callback has returned:
+      thread per call   - a detached std::thread per callback, as the idiom is usually shown,
+      thread_pool       - weak_this::thread_pool of 'threads' threads.
+   The update itself is a relaxed increment, so the cost of dispatching a callback is what is measured.
+   The best of 'rounds' is reported.
+*/
+
+struct options
+{
+   size_t   workers{100'000};
+   size_t   threads{max(1u, thread::hardware_concurrency())};
+   size_t   rounds{3};
+};
+
+options parse(int argc, char* argv[])
+{
+   options o;
+   for(int i{1}; i<argc; ++i) {
+      const string arg{argv[i]};
+      if(i+1>=argc)
+         throw invalid_argument{"missing value of " + arg};
+      const auto value = max<size_t>(1, stoul(argv[++i]));
+      if(arg=="--workers")
+         o.workers = value;
+      else if(arg=="--threads")
+         o.threads = value;
+      else if(arg=="--rounds")
+         o.rounds = value;
+      else
+         throw invalid_argument{"unknown option " + arg};
+   }
+   return o;
+}
+
+/**
+   Counts the callbacks which have returned, wait() blocks until 'expected' of them have
+*/
+class countdown
+{
+   mutex                m_;
+   condition_variable   cv_;
+   size_t               left_;
+public:
+   explicit countdown(size_t expected) : left_(expected) {}
+   void done() {
+      lock_guard<mutex> l{m_};
+      if(--left_==0)
+         cv_.notify_one();
+   }
+   void wait() {
+      unique_lock<mutex> l{m_};
+      cv_.wait(l, [this] { return left_==0; });
+   }
+};
+
+class worker : public enable_shared_from_this<worker>
+{
+   atomic<size_t>&   updates_;
+public:
+   explicit worker(atomic<size_t>& updates) : updates_(updates) {}
+
+   void do_update() {
+      updates_.fetch_add(1, memory_order_relaxed);
+   }
+
+   void async_update(countdown& c) {
+      thread{[wp = weak_from_this(), &c]() {
+            if(auto sp=wp.lock())
+               sp->do_update();
+            c.done();
+         }
+      }.detach();
+   }
+
+   template <typename Executor>
+   void async_update(Executor& ex, countdown& c) {
+      ex.post([wp = weak_from_this(), &c]() {
+            if(auto sp=wp.lock())
+               sp->do_update();
+            c.done();
+         });
+   }
+};
+
+/**
+   \return callbacks per second of the best round, 'dispatch(worker, countdown)' starts the callback of a worker
+*/
+double measure(const options& o, const function<void(worker&, countdown&)>& dispatch)
+{
+   double best{0};
+   for(size_t r{0}; r<o.rounds; ++r) {
+      atomic<size_t> updates{0};
+      vector<shared_ptr<worker>> workers;
+      workers.reserve(o.workers);
+      for(size_t i{0}; i<o.workers; ++i)
+         workers.push_back(make_shared<worker>(updates));
+
+      countdown c{o.workers};
+      const auto start = steady_clock::now();
+      for(auto& w : workers)
+         dispatch(*w, c);
+      c.wait();
+      const auto seconds = duration<double>(steady_clock::now()-start).count();
+      if(updates.load()!=o.workers)
+         throw logic_error{"a callback has not updated its worker"};
+      best = max(best, o.workers / seconds);
+   }
+   return best;
+}
+
+int main(int argc, char* argv[])
+{
+   try {
+      const auto o = parse(argc, argv);
+      cout << "*** " << o.workers << " callbacks, " << thread::hardware_concurrency() << " hardware threads, best of " << o.rounds << "\n"
+           << fixed << setprecision(0);
+
+      const auto per_call = measure(o, [](worker& w, countdown& c) { w.async_update(c); });
+      cout << left << setw(28) << "thread per call" << right << setw(12) << per_call << " callbacks/s\n";
+
+      weak_this::thread_pool pool{o.threads};
+      const auto pooled = measure(o, [&](worker& w, countdown& c) { w.async_update(pool, c); });
+      cout << left << setw(28) << "thread_pool (" + to_string(pool.size()) + " threads)" << right << setw(12) << pooled << " callbacks/s"
+           << setprecision(1) << "  x" << pooled / per_call << "\n";
+      this_thread::sleep_for(milliseconds{10});   // <-- the last detached threads are exiting
+   }
+   catch(const system_error& e) {
+      cerr << "*** cannot start a thread: " << e.what() << "\n";   // <-- e.g. too many threads are alive at once
+      return EXIT_FAILURE;
+   }
+   catch(const exception& e) {
+      cerr << "*** error: " << e.what() << "\n";
+      return EXIT_FAILURE;
+   }
+}
@@ -6,6 +6,8 @@
 #include <mutex>
 #include <memory>
 
+#include "thread_pool.h"
+
 using namespace std;
 using namespace std::chrono_literals;
 
@@ -37,13 +39,17 @@ public:
       out_.insert(id_); 
    }
 
-   void async_update()
+   /**
+      'ex' is anything with post(std::function<void()>), e.g. weak_this::thread_pool:
+      a bounded number of threads serves all the callbacks instead of a thread per call
+   */
+   template <typename Executor>
+   void async_update(Executor& ex)
    {
-      thread{[wp = weak_from_this()]() { // <-- gives a task execution away for other thread
-            if(auto sp=wp.lock())        // the guarantee the instance of worker is not destroyed yet
-               sp->do_update();   
-         }
-      }.detach();                        // <-- and forgets about it
+      ex.post([wp = weak_from_this()]() { // <-- gives a task execution away for a thread of the pool
+            if(auto sp=wp.lock())         // the guarantee the instance of worker is not destroyed yet
+               sp->do_update();
+         });                              // <-- and forgets about it
    }
 }; 
 
@@ -51,7 +57,8 @@ size_t worker::counter_{0};
 
 int main()
 {
-   destination        result;
+   destination             result;
+   weak_this::thread_pool  pool;    // <-- after 'result': a running callback writes into it, so the pool is joined first
    {
       vector<shared_ptr<worker>> workers;
       for(size_t i=0; i<100; ++i)
@@ -59,7 +66,7 @@ int main()
       cout << "total workers: " << workers.size() << endl;
 
       // starting of the asynchronous (!!!) work ...
-      for(auto&& w:workers) w->async_update();
+      for(auto&& w:workers) w->async_update(pool);
 
       cout << "done before of the block: " << result.size() << endl;
    }  // <-- all workers are being destroyed here ...
@@ -68,7 +75,7 @@ int main()
    for(auto&& rec:result) 
       cout << rec.first << " -> "<< rec.second << endl;
 
-   this_thread::sleep_for(10ms);  // <-- just to make sure all threads have been completed
-   cout << "done at the end of main: " << result.size() << endl;
+   pool.wait();   // <-- the callbacks of destroyed workers have found nothing to update
+   cout << "done at the end of main: " << result.size() << " (by " << pool.size() << " threads)" << endl;
 }
 
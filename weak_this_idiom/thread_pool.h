@@ -0,0 +1,128 @@
+#if !defined(_WEAK_THIS_THREAD_POOL_H__)
+#define _WEAK_THIS_THREAD_POOL_H__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace weak_this
+{
+   /**
+      A fixed number of threads which run posted tasks in the order they are posted.
+      A task costs a queue node instead of a thread creation, so a burst of 100k callbacks
+      is served by a handful of threads rather than by 100k of them.
+      The destructor runs the tasks which are still queued and joins the threads.
+      An exception thrown by a task does not stop its thread: the first one is kept and rethrown by wait(),
+      the later ones (and the first one if wait() is never called) are discarded.
+
+      Usage Example:
+         thread_pool pool;   // <-- std::thread::hardware_concurrency() threads
+         pool.post([wp = weak_from_this()] { if(auto sp = wp.lock()) sp->do_update(); });
+         pool.wait();        // <-- every task posted so far has run, throws the first exception of a task if there was one
+   */
+   class thread_pool {
+      std::mutex                          m_;
+      std::condition_variable             posted_;   // a task is queued or the pool is stopping
+      std::condition_variable             idle_;     // the queue is empty and no task is running
+      std::deque<std::function<void()>>   tasks_;
+      std::size_t                         running_{0};
+      bool                                stop_{false};
+      std::exception_ptr                  error_;    // the first exception thrown by a task since the last wait()
+      std::vector<std::thread>            threads_;
+
+      void run() {
+         std::unique_lock<std::mutex> l{m_};
+         for(;;) {
+            posted_.wait(l, [this] { return stop_ || !tasks_.empty(); });
+            if(tasks_.empty())
+               return;   // <-- stopping, and nothing is left to run
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ++running_;
+            l.unlock();
+            std::exception_ptr error;
+            try {
+               task();
+            }
+            catch(...) {
+               error = std::current_exception();   // <-- a task must not take a thread of the pool down with it
+            }
+            task = nullptr;   // <-- the captures are released outside of the lock
+            l.lock();
+            if(error && !error_)
+               error_ = std::move(error);
+            if(--running_==0 && tasks_.empty())
+               idle_.notify_all();
+         }
+      }
+
+      void stop() noexcept {
+         {
+            std::lock_guard<std::mutex> l{m_};
+            stop_ = true;
+         }
+         posted_.notify_all();
+         for(auto& t : threads_)
+            t.join();
+      }
+
+   public:
+      /**
+         \throw std::invalid_argument if 'threads' is 0, such a pool would never run a task
+      */
+      explicit thread_pool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+         if(threads==0)
+            throw std::invalid_argument{"weak_this::thread_pool: no threads"};
+         threads_.reserve(threads);
+         try {
+            for(std::size_t i{0}; i<threads; ++i)
+               threads_.emplace_back(&thread_pool::run, this);
+         }
+         catch(...) {
+            stop();   // <-- the threads started so far
+            throw;
+         }
+      }
+      ~thread_pool() {
+         stop();
+      }
+      thread_pool(const thread_pool&) = delete;
+      thread_pool& operator=(const thread_pool&) = delete;
+
+      void post(std::function<void()> task) {
+         {
+            std::lock_guard<std::mutex> l{m_};
+            tasks_.push_back(std::move(task));
+         }
+         posted_.notify_one();
+      }
+
+      /**
+         Waits until every task posted so far (and those they post) has run
+         \throw the first exception thrown by a task since the previous wait(), the pool keeps running
+      */
+      void wait() {
+         std::unique_lock<std::mutex> l{m_};
+         idle_.wait(l, [this] { return tasks_.empty() && running_==0; });
+         if(auto error = std::exchange(error_, nullptr)) {
+            l.unlock();
+            std::rethrow_exception(error);
+         }
+      }
+
+      std::size_t size() const noexcept {
+         return threads_.size();
+      }
+   };
+
+}  // end namespace weak_this
+
+#endif // _WEAK_THIS_THREAD_POOL_H__